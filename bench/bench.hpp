@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+ * Shared helpers for the benchmarks in this directory
+ */
+
+#ifdef DEBUG_TRACE_EXECUTION
+#error "Build benchmarks with DEBUG_TRACE_EXECUTION=0"
+#endif
+
+#include <chrono>
+#include <stdio.h>
+
+// Monotonic time in seconds
+static inline double benchNow() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Report a timing result in a consistent format
+static inline void benchReport(char const * name, double seconds, double ops, char const * unit) {
+    printf("  %-32s %10.3f ms  %10.2f ns/%s\n", name, seconds * 1e3, seconds * 1e9 / ops, unit);
+}
@@ -0,0 +1,84 @@
+/**
+ * Instruction dispatch benchmark
+ *
+ * Runs the same chunk repeatedly and reports the average time per executed instruction.
+ * Compare the dispatch modes by rebuilding with COMPUTED_GOTO=0 and COMPUTED_GOTO=1.
+ *
+ * The literal statements mostly fold away at compile time, leaving the cheapest opcodes.
+ * The operator statements work on globals, so every operator runs and passes its result
+ * straight to the next (where caching the top of the stack in a register pays off).
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+
+#include <stdlib.h>
+#include <string>
+
+static int const RUNS = 200000;
+
+// A mix of cheap opcodes so that dispatch dominates:
+static char const * const STATEMENTS[] = {
+    "!(1 < 2) == !nil;\n",
+    "-3 * 4 + 5 - 6 / 7 >= 8;\n",
+    "true != false == !true;\n",
+    "nil == nil != (9 <= -10);\n",
+    "11 + 12 + 13 + 14 > 15 * 16;\n",
+};
+
+static char const * const OPERATOR_STATEMENTS[] = {
+    "!(a < b) == !c;\n",
+    "-a * b + c - a / b >= c;\n",
+    "a + b + c + a > b * c;\n",
+    "(a - b) * (b - c) <= -(c / a);\n",
+};
+
+// Time per instruction of running the statements (repeated 10 times) as one chunk
+static void run_(Vm & vm, char const * name, char const * const * statements, size_t count) {
+    std::string source;
+    for( int i = 0; i < 10; ++i ){
+        for( size_t s = 0; s < count; ++s ){
+            source += statements[s];
+        }
+    }
+
+    Chunk chunk;
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        exit(1);
+    }
+
+    // Straight-line code: every instruction executes exactly once per run
+    int instructions = 0;
+    for( int offset = 0; offset < chunk.count(); ){
+        offset += OpCode::instructionLength(chunk.getCode()[offset]);
+        instructions++;
+    }
+    printf("  %-30s %10d\n", (std::string(name) + " instructions per run").c_str(), instructions);
+
+    double start = benchNow();
+    for( int i = 0; i < RUNS; ++i ){
+        vm.run(chunk);
+    }
+    double elapsed = benchNow() - start;
+    benchReport(name, elapsed, (double)RUNS * instructions, "instruction");
+}
+
+int main() {
+#ifdef COMPUTED_GOTO
+    printf("Dispatch: computed goto\n");
+#else
+    printf("Dispatch: switch\n");
+#endif
+
+    Vm vm;
+    vm.setJitMode(JitMode::NEVER);  // measure the interpreter, not compiled code
+    vm.interpret("var a = 1.5; var b = 2.25; var c = -3;");
+
+    run_(vm, "dispatch", STATEMENTS, sizeof(STATEMENTS) / sizeof(STATEMENTS[0]));
+    run_(vm, "operators", OPERATOR_STATEMENTS, sizeof(OPERATOR_STATEMENTS) / sizeof(OPERATOR_STATEMENTS[0]));
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * Garbage collector benchmark
+ *
+ * Runs a chunk which creates a new string per statement (garbage as soon as it is popped),
+ * once with the default collection threshold and once with collection effectively disabled.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+
+#include <string>
+
+static int const STATEMENTS = 100;
+static int const RUNS = 5000;
+
+static void run(char const * name, size_t threshold) {
+    std::string source;
+    for( int i = 0; i < STATEMENTS; ++i ){
+        source += "\"item\" + (n = n + 1);\n";
+    }
+
+    Vm vm;
+    vm.setJitMode(JitMode::NEVER);  // measure the interpreter, not compiled code
+    vm.setGcThreshold(threshold);
+    vm.interpret("var n = 0;");
+    Chunk chunk;
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return;
+    }
+
+    double start = benchNow();
+    for( int i = 0; i < RUNS; ++i ){
+        vm.run(chunk);
+    }
+    double elapsed = benchNow() - start;
+
+    GcStats const & stats = vm.getGcStats();
+    printf("%s:\n", name);
+    benchReport("string statements", elapsed, (double)STATEMENTS * RUNS, "statement");
+    printf("  bytes still allocated            %10zu\n", stats.bytesAllocated);
+    printf("  bytes freed                      %10zu\n", stats.bytesFreed);
+    printf("  collections                      %10d\n", stats.collections);
+    printf("  total / max pause                %10.3f / %.3f ms\n", stats.totalPauseMs, stats.maxPauseMs);
+}
+
+int main() {
+    run("Default GC threshold", 1024 * 1024);
+    run("GC disabled", (size_t)-1);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * String hash benchmark
+ *
+ * Compares hashString against byte-at-a-time FNV-1a (the previous hash) for quality
+ * (32-bit collisions and linear probing cost in a power-of-two table, as StringSet
+ * uses) on identifier-like and long-text corpora, and for throughput by length.
+ */
+
+#include "bench.hpp"
+
+#include "str.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+static uint32_t fnv1a_(char const * str, int length) {
+    uint32_t hash = 2166136261u;
+    for( int i = 0; i < length; i++ ){
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+typedef uint32_t (*HashFn)(char const *, int);
+
+static HashFn const HASHES_[] = {fnv1a_, hashString};
+static char const * const NAMES_[] = {"FNV-1a", "hashString"};
+
+// Full 32-bit collisions, and mean probes per key inserting into a table at 50% load
+static void quality_(char const * corpus, std::vector<std::string> const & keys) {
+    printf("  %s (%zu keys)\n", corpus, keys.size());
+    size_t capacity = 1;
+    while( capacity < keys.size() * 2 ) capacity <<= 1;
+
+    for( int h = 0; h < 2; ++h ){
+        std::vector<uint32_t> hashes;
+        for( std::string const & key : keys ){
+            hashes.push_back(HASHES_[h](key.data(), (int)key.size()));
+        }
+
+        std::vector<bool> used(capacity);
+        long probes = 0;
+        for( uint32_t hash : hashes ){
+            size_t index = hash & (capacity - 1);
+            probes++;
+            while( used[index] ){
+                index = (index + 1) & (capacity - 1);
+                probes++;
+            }
+            used[index] = true;
+        }
+
+        std::sort(hashes.begin(), hashes.end());
+        long collisions = 0;
+        for( size_t i = 1; i < hashes.size(); ++i ){
+            collisions += hashes[i] == hashes[i - 1];
+        }
+        printf("    %-30s %8ld collisions  %6.2f probes/key\n", NAMES_[h], collisions,
+               (double)probes / (double)keys.size());
+    }
+}
+
+static void throughput_(int length) {
+    std::string text;
+    std::mt19937 rng(length);
+    for( int i = 0; i < length + 64; ++i ) text += (char)('a' + rng() % 26);
+    long const bytes = 256L * 1024 * 1024;
+    long const count = std::max(bytes / length, 1000000L / std::max(1, length / 64));
+
+    char label[64];
+    for( int h = 0; h < 2; ++h ){
+        uint32_t sum = 0;
+        double start = benchNow();
+        for( long i = 0; i < count; ++i ){
+            // vary the start so the loop can't be hoisted
+            sum += HASHES_[h](text.data() + (i & 63), length);
+        }
+        double elapsed = benchNow() - start;
+        snprintf(label, sizeof(label), "%s, %d bytes", NAMES_[h], length);
+        printf("  %-32s %10.2f ns/hash  %8.2f GB/s%s\n", label, elapsed * 1e9 / (double)count,
+               (double)length * (double)count / elapsed / 1e9, sum == 1 ? " " : "");
+    }
+}
+
+int main() {
+    printf("Hash quality\n");
+    std::vector<std::string> keys;
+    char buffer[64];
+
+    for( int i = 0; i < 200000; ++i ){
+        snprintf(buffer, sizeof(buffer), "x%d", i);
+        keys.push_back(buffer);
+    }
+    quality_("short identifiers x0, x1, ...", keys);
+
+    keys.clear();
+    static char const * const WORDS[] = {"user", "count", "total", "index", "name", "value", "row", "tmp"};
+    for( int i = 0; i < 200000; ++i ){
+        snprintf(buffer, sizeof(buffer), "%s_%s%d", WORDS[i % 8], WORDS[(i / 8) % 8], i / 64);
+        keys.push_back(buffer);
+    }
+    quality_("compound identifiers", keys);
+
+    keys.clear();
+    std::mt19937 rng(1);
+    std::string prefix;
+    for( int i = 0; i < 500; ++i ) prefix += WORDS[rng() % 8], prefix += ' ';
+    for( int i = 0; i < 100000; ++i ){
+        snprintf(buffer, sizeof(buffer), "%d", i);
+        keys.push_back(prefix + buffer);  // long text differing only at the end
+    }
+    quality_("long text, differing suffix", keys);
+
+    printf("Hash throughput\n");
+    int const lengths[] = {3, 8, 16, 32, 64, 256, 1024, 16384};
+    for( int length : lengths ){
+        throughput_(length);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * Integer benchmark
+ *
+ * Re-runs a chunk of counter arithmetic on globals with integers, doubles and a mix of
+ * the two (double counters stepped by integer literals), interpreted and compiled to
+ * native code. Then formats a range of whole numbers as integers and as doubles, as
+ * print and string concatenation do.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "number.hpp"
+
+#include <string>
+
+static int const STATEMENTS = 40;
+static int const RUNS = 200000;
+static int const FORMATS = 10000000;
+
+static void run(char const * name, char const * globals, char const * statement, JitMode mode) {
+    Vm vm;
+    vm.setJitMode(mode);
+    vm.interpret(globals);
+
+    std::string source;
+    for( int i = 0; i < STATEMENTS; ++i ){
+        source += statement;
+    }
+    Chunk chunk;
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return;
+    }
+
+    double start = benchNow();
+    for( int i = 0; i < RUNS; ++i ){
+        vm.run(chunk);
+    }
+    benchReport(name, benchNow() - start, (double)RUNS * STATEMENTS, "statement");
+}
+
+int main() {
+    printf("Integers:\n");
+    static char const * const INTEGERS = "var i = 0; var j = 100000000;";
+    static char const * const DOUBLES = "var i = 0.0; var j = 100000000.0;";
+    run("interpreted integers", INTEGERS, "i = i + 1; j = j - 1; i * 3 < j;\n", JitMode::NEVER);
+    run("interpreted doubles", DOUBLES, "i = i + 1.0; j = j - 1.0; i * 3.0 < j;\n", JitMode::NEVER);
+    run("interpreted mixed", DOUBLES, "i = i + 1; j = j - 1; i * 3 < j;\n", JitMode::NEVER);
+    if( Jit::isSupported() ){
+        run("compiled integers", INTEGERS, "i = i + 1; j = j - 1; i * 3 < j;\n", JitMode::ALWAYS);
+        run("compiled doubles", DOUBLES, "i = i + 1.0; j = j - 1.0; i * 3.0 < j;\n", JitMode::ALWAYS);
+        run("compiled mixed", DOUBLES, "i = i + 1; j = j - 1; i * 3 < j;\n", JitMode::ALWAYS);
+    }
+
+    char buffer[NUMBER_BUFFER_SIZE];
+    size_t total = 0;  // keep the results live
+    double start = benchNow();
+    for( int i = 0; i < FORMATS; ++i ){
+        total += (size_t)formatInteger((int64_t)i * 7919, buffer);
+    }
+    benchReport("formatInteger", benchNow() - start, FORMATS, "number");
+
+    start = benchNow();
+    for( int i = 0; i < FORMATS; ++i ){
+        total += (size_t)formatNumber((double)((int64_t)i * 7919), buffer);
+    }
+    benchReport("formatNumber (whole doubles)", benchNow() - start, FORMATS, "number");
+    printf("  (%zu characters)\n", total);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * String interning benchmark
+ *
+ * Measures intern table hit and miss latency of StringSet against a node-based
+ * std::unordered_set of string_views, and globals lookup by interned name (HashMap).
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "table.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_set>
+
+static int const STRINGS = 20000;
+static int const ROUNDS = 50;
+
+struct ViewHash_ {
+    size_t operator()(std::string_view s) const { return hashString(s.data(), (int)s.size()); }
+};
+
+int main() {
+    Vm vm;
+    vm.setGcThreshold(SIZE_MAX);  // the strings aren't rooted anywhere
+    std::unordered_set<std::string_view, ViewHash_> nodeSet;
+
+    // identifier-like names which are interned, and a disjoint set which aren't:
+    std::vector<std::string> present, absent;
+    char name[32];
+    for( int i = 0; i < STRINGS; ++i ){
+        snprintf(name, sizeof(name), "var_%d", i);
+        present.push_back(name);
+        snprintf(name, sizeof(name), "missing_%d", i);
+        absent.push_back(name);
+    }
+    std::vector<ObjString *> names;
+    HashMap globals;
+    for( std::string & s : present ){
+        ObjString * ostr = ObjString::newString(&vm, s.c_str(), (int)s.size());
+        nodeSet.emplace(ostr->get(), (size_t)ostr->getLength());
+        globals.set(ostr, Value::number((double)names.size()));
+        names.push_back(ostr);
+    }
+
+    StringSet * set = vm.getInternedStrings();
+    double ops = (double)STRINGS * ROUNDS;
+    size_t found = 0;
+
+    printf("Intern lookups (%d strings):\n", STRINGS);
+    for( int pass = 0; pass < 2; ++pass ){
+        std::vector<std::string> & keys = pass == 0 ? present : absent;
+        char const * what = pass == 0 ? "hit" : "miss";
+        char label[64];
+
+        double start = benchNow();
+        for( int r = 0; r < ROUNDS; ++r ){
+            for( std::string & s : keys ){
+                found += nodeSet.find(std::string_view(s)) != nodeSet.end();
+            }
+        }
+        snprintf(label, sizeof(label), "unordered_set %s", what);
+        benchReport(label, benchNow() - start, ops, "lookup");
+
+        start = benchNow();
+        for( int r = 0; r < ROUNDS; ++r ){
+            for( std::string & s : keys ){
+                found += set->find(StringKey::of(s.c_str(), (int)s.size())) != nullptr;
+            }
+        }
+        snprintf(label, sizeof(label), "StringSet %s", what);
+        benchReport(label, benchNow() - start, ops, "lookup");
+    }
+
+    double start = benchNow();
+    for( int r = 0; r < ROUNDS; ++r ){
+        for( ObjString * name : names ){
+            Value slot;
+            found += globals.get(name, slot);
+        }
+    }
+    benchReport("HashMap get (globals)", benchNow() - start, ops, "lookup");
+
+    // keep the lookups from being optimised away:
+    if( found != (size_t)STRINGS * ROUNDS * 3 ) printf("unexpected hit count %zu\n", found);
+    return 0;
+}
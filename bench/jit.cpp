@@ -0,0 +1,54 @@
+/**
+ * JIT benchmark
+ *
+ * Re-runs chunks of arithmetic on globals and of string concatenation, interpreted
+ * and compiled to native code.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+
+#include <string>
+
+static int const STATEMENTS = 40;
+static int const RUNS = 200000;
+
+static void run(char const * name, char const * statement, JitMode mode) {
+    Vm vm;
+    vm.setJitMode(mode);
+    vm.setGcThreshold(SIZE_MAX);
+    vm.interpret("var x = 1.5; var y = 2.25; var s = \"s\";");
+
+    std::string source;
+    for( int i = 0; i < STATEMENTS; ++i ){
+        source += statement;
+    }
+    Chunk chunk;
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return;
+    }
+
+    double start = benchNow();
+    for( int i = 0; i < RUNS; ++i ){
+        vm.run(chunk);
+    }
+    benchReport(name, benchNow() - start, (double)RUNS * STATEMENTS, "statement");
+}
+
+int main() {
+    if( !Jit::isSupported() ){
+        printf("JIT not supported on this platform/build\n");
+        return 0;
+    }
+    printf("JIT:\n");
+    run("interpreted arithmetic", "x * y + x - y / x < y;\n", JitMode::NEVER);
+    run("compiled arithmetic", "x * y + x - y / x < y;\n", JitMode::ALWAYS);
+    run("interpreted strings", "s + x == s;\n", JitMode::NEVER);
+    run("compiled strings", "s + x == s;\n", JitMode::ALWAYS);
+    return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * Lexer benchmark
+ *
+ * Scans a large data-like script (long strings, comments, indentation and numbers)
+ * with each SIMD level the CPU supports, and reports throughput in MB/s.
+ */
+
+#include "bench.hpp"
+
+#include "scanner.hpp"
+#include "simd.hpp"
+
+#include <string>
+
+static int const ROWS = 200000;
+static int const RUNS = 5;
+
+// Scan every token, returning the number of tokens (and the last line, to check levels agree)
+static long scanAll_(std::string const & source, int & lastLine) {
+    Scanner scanner;
+    scanner.init(source.c_str());
+    long tokens = 0;
+    for( ;; ){
+        Token token = scanner.scanToken();
+        tokens++;
+        if( token.type == Token::END ){
+            lastLine = token.line;
+            return tokens;
+        }
+    }
+}
+
+int main() {
+    std::string source;
+    char line[256];
+    for( int i = 0; i < ROWS; ++i ){
+        snprintf(line, sizeof(line),
+                 "        var row%d = \"name %d, a longer description of the row\";    # row %d of the table\n"
+                 "        print 1234567.%d + 98765432%d;\n\n",
+                 i, i, i, i, i % 10);
+        source += line;
+    }
+    double megabytes = (double)source.size() / (1024 * 1024);
+    printf("Lexer (%.1f MB, %d lines)\n", megabytes, ROWS * 3);
+
+    long expectedTokens = -1;
+    int expectedLine = -1;
+    Simd::Level const levels[] = {Simd::Level::SCALAR, Simd::Level::SSE2, Simd::Level::AVX2};
+    for( Simd::Level level : levels ){
+        if( !Simd::setLevel(level) ){
+            printf("  %-32s not supported\n", Simd::levelName(level));
+            continue;
+        }
+
+        long tokens = 0;
+        int lastLine = 0;
+        double start = benchNow();
+        for( int r = 0; r < RUNS; ++r ){
+            tokens = scanAll_(source, lastLine);
+        }
+        double elapsed = benchNow() - start;
+
+        if( expectedTokens < 0 ){
+            expectedTokens = tokens;
+            expectedLine = lastLine;
+        }else if( tokens != expectedTokens || lastLine != expectedLine ){
+            printf("  %s disagrees with scalar: %ld tokens, line %d\n", Simd::levelName(level), tokens, lastLine);
+            return 1;
+        }
+        printf("  %-32s %10.1f MB/s  %10.2f ns/token\n", Simd::levelName(level),
+               megabytes * RUNS / elapsed, elapsed * 1e9 / ((double)tokens * RUNS));
+    }
+    Simd::setLevel(Simd::bestLevel());
+    return 0;
+}
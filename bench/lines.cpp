@@ -0,0 +1,62 @@
+/**
+ * Line table benchmark
+ *
+ * Reports line table memory per instruction for a large generated script, against the
+ * previous layout (one uint16_t line number per byte of bytecode), and the time taken
+ * to look up the line of every instruction.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+
+#include <string>
+
+static int const STATEMENTS = 4000;  // keeps under Chunk's bytecode limit
+
+int main() {
+    // One statement per line, mixing short and long instructions:
+    std::string source;
+    char line[128];
+    for( int i = 0; i < STATEMENTS; ++i ){
+        snprintf(line, sizeof(line), "var v%d = %d + %d * 2;\n", i, i, i + 1);
+        source += line;
+    }
+
+    Vm vm;
+    Chunk chunk;
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return 1;
+    }
+
+    int instructions = 0;
+    uint8_t const * code = chunk.getCode();
+    for( int offset = 0; offset < chunk.count(); offset += OpCode::instructionLength(code[offset]) ){
+        ++instructions;
+    }
+    size_t const perByteBytes = (size_t)chunk.count() * sizeof(uint16_t);
+    size_t const rleBytes = chunk.lineTableBytes();
+
+    printf("Line table (%d lines, %d instructions, %d bytes of bytecode)\n",
+           STATEMENTS, instructions, chunk.count());
+    printf("  per-byte line table              %10zu bytes  %6.2f bytes/instruction\n",
+           perByteBytes, (double)perByteBytes / instructions);
+    printf("  run-length line table            %10zu bytes  %6.2f bytes/instruction\n",
+           rleBytes, (double)rleBytes / instructions);
+
+    // Look up every instruction's line, as the disassembler does:
+    int const RUNS = 200;
+    unsigned checksum = 0;
+    double start = benchNow();
+    for( int r = 0; r < RUNS; ++r ){
+        for( int offset = 0; offset < chunk.count(); offset += OpCode::instructionLength(code[offset]) ){
+            checksum += chunk.getLineNumber(offset);
+        }
+    }
+    double elapsed = benchNow() - start;
+    benchReport("getLineNumber", elapsed, (double)RUNS * instructions, "lookup");
+    return checksum == 0;  // keep the loop from being optimised away
+}
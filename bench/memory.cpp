@@ -0,0 +1,57 @@
+/**
+ * Object memory benchmark
+ *
+ * Heap bytes per string on a string-heavy workload: a million short, distinct
+ * identifier-like strings (as a script building keys or names would make), kept live.
+ * Reports the object header and string sizes, the bytes the Vm accounts for, the
+ * arena blocks they round up to, and the growth in peak RSS.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "memory.hpp"
+
+#include <sys/resource.h>
+
+static int const STRINGS = 1000000;
+
+static long maxRssKb_() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main() {
+    // names are formatted in advance so only the strings themselves are measured
+    static char names[STRINGS][16];
+    size_t chars = 0;
+    for( int i = 0; i < STRINGS; ++i ){
+        chars += (size_t)snprintf(names[i], sizeof(names[i]), "key_%d", i);
+    }
+
+    Vm vm;
+    vm.setGcThreshold(SIZE_MAX);  // keep everything live
+    long rssBefore = maxRssKb_();
+    size_t bytesBefore = vm.getGcStats().bytesAllocated;
+
+    double start = benchNow();
+    size_t blocks = 0;
+    for( int i = 0; i < STRINGS; ++i ){
+        ObjString * ostr = ObjString::newString(&vm, names[i]);
+        size_t size = ObjString::allocationSize(ostr->getLength());
+        blocks += (size + Arena::GRANULE - 1) / Arena::GRANULE * Arena::GRANULE;
+    }
+    double elapsed = benchNow() - start;
+    size_t bytes = vm.getGcStats().bytesAllocated - bytesBefore;
+    long rss = maxRssKb_() - rssBefore;
+
+    printf("Objects (%d strings, %.1f chars average):\n", STRINGS, (double)chars / STRINGS);
+    printf("  sizeof(Obj)                      %10zu bytes\n", sizeof(Obj));
+    printf("  sizeof(ObjString)                %10zu bytes\n", sizeof(ObjString));
+    printf("  object bytes per string          %10.2f\n", (double)bytes / STRINGS);
+    printf("  arena block bytes per string     %10.2f\n", (double)blocks / STRINGS);
+    printf("  peak RSS growth per string       %10.2f bytes\n", (double)rss * 1024 / STRINGS);
+    benchReport("new string", elapsed, STRINGS, "string");
+    return 0;
+}
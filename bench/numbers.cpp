@@ -0,0 +1,91 @@
+/**
+ * Number literal benchmark
+ *
+ * Compiles a script of a million numeric literals, and times parseNumber against
+ * strtod on the same literals, then formatNumber against snprintf("%g") on their values.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+#include "number.hpp"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+static int const LITERALS = 1000000;
+
+int main() {
+    // A mix of integers, short decimals and long (hard case) decimals:
+    std::string source;
+    std::vector<size_t> offsets;
+    char literal[64];
+    for( int i = 0; i < LITERALS; ++i ){
+        switch( i % 4 ){
+            case 0: snprintf(literal, sizeof(literal), "%d", i); break;
+            case 1: snprintf(literal, sizeof(literal), "%d.%d", i / 7, i % 1000); break;
+            case 2: snprintf(literal, sizeof(literal), "0.%06d", i); break;
+            case 3: snprintf(literal, sizeof(literal), "%d.%d%d%d", i, i, i, i); break;
+        }
+        offsets.push_back(source.size());
+        source += literal;
+        source += ";\n";
+    }
+    double megabytes = (double)source.size() / (1024 * 1024);
+    printf("Number literals (%d literals, %.1f MB)\n", LITERALS, megabytes);
+
+    Vm vm;
+    Chunk chunk;
+    Compiler compiler(&vm);
+    double start = benchNow();
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return 1;
+    }
+    double elapsed = benchNow() - start;
+    benchReport("compile", elapsed, LITERALS, "literal");
+    printf("  %-32s %10.1f MB/s\n", "compile throughput", megabytes / elapsed);
+
+    // Conversion alone, each literal ends at its ';':
+    double sum = 0;
+    start = benchNow();
+    for( size_t offset : offsets ){
+        char const * text = source.c_str() + offset;
+        sum += parseNumber(text, (int)(strchr(text, ';') - text));
+    }
+    benchReport("parseNumber", benchNow() - start, LITERALS, "literal");
+
+    double check = 0;
+    start = benchNow();
+    for( size_t offset : offsets ){
+        check += strtod(source.c_str() + offset, nullptr);
+    }
+    benchReport("strtod", benchNow() - start, LITERALS, "literal");
+
+    if( sum != check ){
+        printf("  parseNumber disagrees with strtod\n");
+        return 1;
+    }
+
+    // Formatting the values back:
+    std::vector<double> values;
+    for( int i = 0; i < chunk.numConstants(); ++i ){
+        values.push_back(chunk.getConstant(i).asNumber());
+    }
+    char buffer[NUMBER_BUFFER_SIZE];
+    long length = 0;
+    start = benchNow();
+    for( double value : values ){
+        length += formatNumber(value, buffer);
+    }
+    benchReport("formatNumber", benchNow() - start, (double)values.size(), "value");
+
+    start = benchNow();
+    for( double value : values ){
+        length += snprintf(buffer, sizeof(buffer), "%g", value);
+    }
+    benchReport("snprintf %g", benchNow() - start, (double)values.size(), "value");
+    return length == 0;
+}
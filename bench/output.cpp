@@ -0,0 +1,89 @@
+/**
+ * Output benchmark
+ *
+ * Prints 10M lines to /dev/null: through stdio as print used to (printf per value
+ * then per newline), through the Vm's buffered output, and into an embedder's sink.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+
+static int const STATEMENTS = 1000;  // per chunk, alternating strings and numbers
+static int const RUNS = 10000;       // 10M lines in total
+
+// Sink which just counts what it is given
+class CountingSink: public OutputSink {
+public:
+    virtual void write(char const * chars, size_t length) override {
+        (void)chars;
+        bytes += length;
+        writes++;
+    }
+    size_t bytes = 0;
+    long writes = 0;
+};
+
+int main() {
+    std::string source;
+    for( int i = 0; i < STATEMENTS / 2; ++i ){
+        source += "print \"a line of output\";\nprint 12345;\n";
+    }
+
+    // Everything on stdout goes to /dev/null (the report goes to stderr)
+    int devNull = open("/dev/null", O_WRONLY);
+    if( devNull < 0 || dup2(devNull, STDOUT_FILENO) < 0 ){
+        fprintf(stderr, "can't open /dev/null\n");
+        return 1;
+    }
+    close(devNull);
+    double const lines = (double)STATEMENTS * RUNS;
+    fprintf(stderr, "Output (%.0fM lines to /dev/null)\n", lines / 1e6);
+
+    // The old way: stdio for every value and newline
+    double start = benchNow();
+    for( int r = 0; r < RUNS; ++r ){
+        for( int i = 0; i < STATEMENTS / 2; ++i ){
+            printf("%s", "a line of output");
+            printf("\n");
+            printf("%g", 12345.0);
+            printf("\n");
+        }
+    }
+    fflush(stdout);
+    double elapsed = benchNow() - start;
+    fprintf(stderr, "  %-32s %10.3f ms  %10.2f ns/line\n", "printf", elapsed * 1e3, elapsed * 1e9 / lines);
+
+    Vm vm;
+    vm.setJitMode(JitMode::NEVER);  // measure the interpreter, not compiled code
+    Chunk chunk;
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return 1;
+    }
+
+    start = benchNow();
+    for( int r = 0; r < RUNS; ++r ){
+        vm.run(chunk);
+    }
+    elapsed = benchNow() - start;
+    fprintf(stderr, "  %-32s %10.3f ms  %10.2f ns/line\n", "Vm print (write(2))", elapsed * 1e3, elapsed * 1e9 / lines);
+
+    CountingSink sink;
+    vm.setOutputSink(&sink);
+    start = benchNow();
+    for( int r = 0; r < RUNS; ++r ){
+        vm.run(chunk);
+    }
+    elapsed = benchNow() - start;
+    vm.setOutputSink(nullptr);
+    fprintf(stderr, "  %-32s %10.3f ms  %10.2f ns/line  (%ld writes)\n", "Vm print (sink)", elapsed * 1e3,
+            elapsed * 1e9 / lines, sink.writes);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * Opcode pair profile: which instruction sequences are worth fusing into superinstructions
+ *
+ *     bin/bench_pairs script.pond ...
+ *
+ * Counts adjacent pairs and triples of opcodes in the bytecode the compiler emits for each
+ * script (a built-in sample if none are given), then reports the most frequent, and how
+ * many instructions are left after -O (rewrites and superinstructions).
+ *
+ * Chunks are straight-line code, so every instruction runs exactly once per run: counting
+ * the bytecode is the same as profiling its execution.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+#include "optimizer.hpp"
+#include "debug.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+static int const TOP = 15;
+
+static char const * const SAMPLE_ =
+    "var count = 0;\n"
+    "var total = 10;\n"
+    "var name = \"pond\";\n"
+    "count = count + 1;\n"
+    "total = total - 2;\n"
+    "print count < 100;\n"
+    "print name + \" \" + count;\n"
+    "var ratio = total / 4;\n"
+    "count = count + total * 2;\n"
+    "print count - 1 >= total;\n"
+    "name = name + \"!\";\n"
+    "print !(count == total);\n";
+
+static bool readFile_(char const * path, std::string & out) {
+    FILE * file = fopen(path, "rb");
+    if( file == nullptr ) return false;
+    char buffer[4096];
+    size_t count;
+    while( (count = fread(buffer, 1, sizeof(buffer), file)) > 0 ){
+        out.append(buffer, count);
+    }
+    fclose(file);
+    return true;
+}
+
+static std::vector<uint8_t> opcodes_(Chunk & chunk) {
+    std::vector<uint8_t> ops;
+    for( int offset = 0; offset < chunk.count(); offset += OpCode::instructionLength(chunk.getCode()[offset]) ){
+        ops.push_back(chunk.getCode()[offset]);
+    }
+    return ops;
+}
+
+static void report_(char const * title, std::map<std::string, long> const & counts, long total) {
+    std::vector<std::pair<long, std::string>> sorted;
+    for( auto const & entry : counts ) sorted.push_back({entry.second, entry.first});
+    std::sort(sorted.rbegin(), sorted.rend());
+
+    printf("  %s (of %ld):\n", title, total);
+    for( int i = 0; i < TOP && i < (int)sorted.size(); ++i ){
+        printf("    %8ld  %5.1f%%  %s\n", sorted[i].first, 100.0 * (double)sorted[i].first / (double)total,
+            sorted[i].second.c_str());
+    }
+}
+
+int main(int argc, char ** argv) {
+    std::vector<std::string> sources;
+    for( int i = 1; i < argc; ++i ){
+        std::string source;
+        if( !readFile_(argv[i], source) ){
+            fprintf(stderr, "can't read %s\n", argv[i]);
+            return 1;
+        }
+        sources.push_back(source);
+    }
+    if( sources.empty() ){
+        printf("(no scripts given: profiling a built-in sample)\n");
+        sources.push_back(SAMPLE_);
+    }
+
+    std::map<std::string, long> pairs;
+    std::map<std::string, long> triples;
+    long instructions = 0;
+    long pairCount = 0;    // pairs and triples don't span scripts
+    long tripleCount = 0;
+    long optimized = 0;
+    for( std::string const & source : sources ){
+        Vm vm;  // fresh globals for each script
+        Chunk chunk;
+        Compiler compiler(&vm);
+        if( !compiler.compile(source.c_str(), chunk) ){
+            fprintf(stderr, "compile failed\n");
+            return 1;
+        }
+
+        std::vector<uint8_t> ops = opcodes_(chunk);
+        instructions += (long)ops.size();
+        pairCount += std::max((long)ops.size() - 1, 0L);
+        tripleCount += std::max((long)ops.size() - 2, 0L);
+        for( size_t i = 0; i + 1 < ops.size(); ++i ){
+            std::string pair = std::string(opCodeToStr(ops[i])) + " " + opCodeToStr(ops[i+1]);
+            pairs[pair]++;
+            if( i + 2 < ops.size() ) triples[pair + " " + opCodeToStr(ops[i+2])]++;
+        }
+
+        Optimizer optimizer;
+        optimizer.optimize(chunk);
+        optimized += (long)opcodes_(chunk).size();
+    }
+
+    printf("Opcode pairs:\n");
+    printf("  scripts                          %10zu\n", sources.size());
+    report_("pairs", pairs, std::max(pairCount, 1L));
+    report_("triples", triples, std::max(tripleCount, 1L));
+    printf("  instructions compiled            %10ld\n", instructions);
+    printf("  instructions after -O            %10ld  (%.1f%% fewer dispatches)\n", optimized,
+        instructions > 0 ? 100.0 * (double)(instructions - optimized) / (double)instructions : 0.0);
+    return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * Quickening benchmark
+ *
+ * Re-runs a chunk of arithmetic and comparisons on globals (which can't be constant
+ * folded), so after the first run every operator executes in its quickened form.
+ * A second chunk flips `+` between numbers and strings on every run, so each of its
+ * additions deoptimizes and quickens again: the worst case.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+
+#include <string>
+
+static int const STATEMENTS = 40;
+static int const RUNS = 200000;
+
+static bool compile(Vm & vm, std::string const & source, Chunk & chunk) {
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    Vm vm;
+    vm.setJitMode(JitMode::NEVER);  // measure the interpreter, not compiled code
+    vm.interpret("var x = 1.5; var y = 2.25; var s = 0;");
+
+    std::string source;
+    for( int i = 0; i < STATEMENTS; ++i ){
+        source += "x * y + x - y / x < y;\n";
+    }
+    Chunk arithmetic;
+    if( !compile(vm, source, arithmetic) ) return 1;
+
+    source.clear();
+    for( int i = 0; i < STATEMENTS; ++i ){
+        source += "s + y;\n";
+    }
+    Chunk flipping;
+    if( !compile(vm, source, flipping) ) return 1;
+    Chunk makeNumber, makeString;
+    if( !compile(vm, "s = 0;", makeNumber) || !compile(vm, "s = \"s\";", makeString) ) return 1;
+
+    printf("Quickening:\n");
+    double start = benchNow();
+    for( int i = 0; i < RUNS; ++i ){
+        vm.run(arithmetic);
+    }
+    benchReport("numeric statements", benchNow() - start, (double)RUNS * STATEMENTS, "statement");
+
+    start = benchNow();
+    for( int i = 0; i < RUNS; ++i ){
+        vm.run((i & 1) ? makeString : makeNumber);
+        vm.run(flipping);
+    }
+    benchReport("deoptimizing statements", benchNow() - start, (double)RUNS * STATEMENTS, "statement");
+    return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * String allocation benchmark
+ *
+ * Counts heap allocations (operator new) per string created and per intern hit,
+ * and times string creation, concatenation and lookup.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+
+#include <new>
+#include <stdlib.h>
+
+static size_t allocations = 0;
+
+void * operator new(size_t size) {
+    allocations++;
+    void * ptr = malloc(size == 0 ? 1 : size);
+    if( ptr == nullptr ) abort();
+    return ptr;
+}
+
+void operator delete(void * ptr) noexcept { free(ptr); }
+void operator delete(void * ptr, size_t) noexcept { free(ptr); }
+
+static int const STRINGS = 100000;
+
+int main() {
+    Vm vm;
+    vm.setGcThreshold((size_t)-1);  // measure allocation only
+    char name[32];
+
+    // names are formatted in advance so only the interpreter's allocations are counted
+    static char names[STRINGS][16];
+    for( int i = 0; i < STRINGS; ++i ){
+        snprintf(names[i], sizeof(names[i]), "str_%d", i);
+    }
+
+    printf("Strings (%d each):\n", STRINGS);
+
+    size_t before = allocations;
+    double start = benchNow();
+    for( int i = 0; i < STRINGS; ++i ){
+        ObjString::newString(&vm, names[i]);
+    }
+    benchReport("new string", benchNow() - start, STRINGS, "string");
+    printf("  allocations per new string       %10.3f\n", (double)(allocations - before) / STRINGS);
+
+    before = allocations;
+    start = benchNow();
+    for( int i = 0; i < STRINGS; ++i ){
+        ObjString::newString(&vm, names[i]);
+    }
+    benchReport("intern hit", benchNow() - start, STRINGS, "string");
+    printf("  allocations per intern hit       %10.3f\n", (double)(allocations - before) / STRINGS);
+
+    // "str_" + "<i>" concatenations, all of which are already interned:
+    ObjString * prefix = ObjString::newString(&vm, "str_");
+    ObjString * suffixes[1000];
+    for( int i = 0; i < 1000; ++i ){
+        snprintf(name, sizeof(name), "%d", i);
+        suffixes[i] = ObjString::newString(&vm, name);
+    }
+    before = allocations;
+    start = benchNow();
+    for( int i = 0; i < STRINGS; ++i ){
+        ObjString::concatenate(&vm, prefix, suffixes[i % 1000]);
+    }
+    benchReport("concatenate (interned)", benchNow() - start, STRINGS, "string");
+    printf("  allocations per concatenate      %10.3f\n", (double)(allocations - before) / STRINGS);
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * Value representation benchmark
+ *
+ * Reports the memory footprint of Value and runs an arithmetic-heavy chunk repeatedly. The
+ * operands are globals, so the arithmetic runs instead of being folded at compile time.
+ * Compare the two representations by rebuilding with NAN_BOXING=0 and NAN_BOXING=1.
+ */
+
+#include "bench.hpp"
+
+#include "vm.hpp"
+#include "compiler.hpp"
+
+#include <string>
+
+static int const STATEMENTS = 40;
+static int const RUNS = 200000;
+
+int main() {
+#ifdef NAN_BOXING
+    printf("Value representation: NaN-boxed\n");
+#else
+    printf("Value representation: tagged union\n");
+#endif
+    printf("  sizeof(Value)                    %10zu bytes\n", sizeof(Value));
+
+    // Arithmetic-heavy script: every statement is globals and numeric operators
+    std::string source;
+    for( int i = 0; i < STATEMENTS; ++i ){
+        source += "-a * b + c - d / e < 7;\n";
+    }
+
+    Vm vm;
+    vm.setJitMode(JitMode::NEVER);  // measure the interpreter, not compiled code
+    vm.interpret("var a = 0.5; var b = 1.25; var c = 2.5; var d = 3.75; var e = 4.125;");
+    Chunk chunk;
+    Compiler compiler(&vm);
+    if( !compiler.compile(source.c_str(), chunk) ){
+        fprintf(stderr, "compile failed\n");
+        return 1;
+    }
+    printf("  Constant pool                    %10zu bytes\n", chunk.numConstants() * sizeof(Value));
+    // the Vm reserves the chunk's deepest stack before running it (see Chunk::getMaxStack)
+    printf("  Stack reserved for the chunk     %10zu bytes (depth %d)\n",
+           (size_t)chunk.getMaxStack() * sizeof(Value), chunk.getMaxStack());
+
+    double start = benchNow();
+    for( int i = 0; i < RUNS; ++i ){
+        vm.run(chunk);
+    }
+    double elapsed = benchNow() - start;
+    benchReport("arithmetic chunk", elapsed, (double)RUNS * STATEMENTS, "statement");
+    return 0;
+}
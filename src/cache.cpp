@@ -0,0 +1,423 @@
+#include "cache.hpp"
+#include "vm.hpp"
+#include "str.hpp"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+static char const MAGIC_[4] = {'P', 'N', 'D', 'C'};
+
+// Header flags: compile options which change the bytecode
+static uint32_t const FLAG_OPTIMIZED_ = 1 << 0;
+static uint32_t const FLAG_FOLDED_ = 1 << 1;
+
+// Constant tags
+enum : uint8_t {
+    CONST_NIL_,
+    CONST_FALSE_,
+    CONST_TRUE_,
+    CONST_NUMBER_,
+    CONST_STRING_,
+    CONST_INTEGER_
+};
+
+struct ChunkCache::Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t codeCount;       // bytes of bytecode, which directly follow the header
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int64_t sourceMtime;      // nanoseconds
+    uint32_t numLines;
+    uint32_t numConstants;
+    uint32_t numGlobals;
+    uint32_t maxStack;        // see Chunk::getMaxStack
+};
+
+// 64-bit FNV-1a: the cache key only needs to catch changed sources, not be fast
+uint64_t ChunkCache::hashSource(char const * source, size_t length, uint64_t hash) {
+    for( size_t i = 0; i < length; ++i ){
+        hash ^= (uint8_t)source[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static int64_t mtimeNs_(struct stat const & st) {
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+/**
+ * Bounds checked reads from the mapped file (a truncated cache just fails to load; the
+ * bytecode itself is checked by verifyCode_)
+ */
+struct Reader {
+    uint8_t const * pos;
+    uint8_t const * end;
+
+    bool read(void * out, size_t bytes) {
+        if( (size_t)(end - pos) < bytes ) return false;
+        memcpy(out, pos, bytes);
+        pos += bytes;
+        return true;
+    }
+
+    // A length prefixed string, left in place
+    bool readString(char const *& chars, uint32_t & length) {
+        if( !read(&length, sizeof(length)) ) return false;
+        if( (size_t)(end - pos) < length ) return false;
+        chars = (char const *)pos;
+        pos += length;
+        return true;
+    }
+};
+
+/**
+ * Check cached bytecode only does what compiled bytecode could, before it's run: the Vm
+ * trusts operands and the chunk's maximum stack depth, so corrupt code would otherwise
+ * read and write out of bounds. Quickened opcodes never reach the cache, so are rejected.
+ */
+static bool verifyCode_(uint8_t const * code, uint32_t count, uint32_t numConstants, uint32_t numGlobals,
+                        uint32_t maxStack) {
+    int depth = 0;
+    uint8_t op = 0;
+    for( uint32_t offset = 0; offset < count; offset += (uint32_t)OpCode::instructionLength(op) ){
+        op = code[offset];
+        if( count - offset < (uint32_t)OpCode::instructionLength(op) ) return false;  // truncated
+        uint8_t const * operands = code + offset + 1;
+
+        int64_t constant = -1;  // operands, if it has them
+        int64_t global = -1;
+        int inputs = 0;         // values it takes from the stack
+        switch( op ){
+            case OpCode::NIL:
+            case OpCode::TRUE:
+            case OpCode::FALSE:
+            case OpCode::RETURN:
+                break;
+            case OpCode::CONSTANT:           constant = operands[0]; break;
+            case OpCode::CONSTANT_LONG:      constant = readLongOperand(operands); break;
+            case OpCode::GET_GLOBAL:         global = operands[0]; break;
+            case OpCode::GET_GLOBAL_LONG:    global = readLongOperand(operands); break;
+            case OpCode::DEFINE_GLOBAL:
+            case OpCode::SET_GLOBAL:
+            case OpCode::SET_GLOBAL_POP:     global = operands[0]; inputs = 1; break;
+            case OpCode::DEFINE_GLOBAL_LONG:
+            case OpCode::SET_GLOBAL_LONG:    global = readLongOperand(operands); inputs = 1; break;
+            case OpCode::ADD_GLOBAL_CONST:
+            case OpCode::SUBTRACT_GLOBAL_CONST:
+            case OpCode::LESS_GLOBAL_CONST:
+            case OpCode::DEFINE_GLOBAL_CONST: global = operands[0]; constant = operands[1]; break;
+            case OpCode::POP:
+            case OpCode::PRINT:
+            case OpCode::NEGATE:
+            case OpCode::NOT:
+                inputs = 1;
+                break;
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+            case OpCode::GREATER:
+            case OpCode::GREATER_EQUAL:
+            case OpCode::LESS:
+            case OpCode::LESS_EQUAL:
+            case OpCode::ADD:
+            case OpCode::SUBTRACT:
+            case OpCode::MULTIPLY:
+            case OpCode::DIVIDE:
+                inputs = 2;
+                break;
+            default:
+                return false;
+        }
+        if( constant >= (int64_t)numConstants || global >= (int64_t)numGlobals ) return false;
+
+        if( depth < inputs ) return false;
+        depth += OpCode::stackEffect(op);
+        if( depth > (int)maxStack ) return false;
+    }
+    return count > 0 && op == OpCode::RETURN;  // never runs off the end
+}
+
+/**
+ * Buffered up output for the cache file
+ */
+struct Writer {
+    std::vector<uint8_t> bytes;
+
+    void write(void const * data, size_t size) {
+        uint8_t const * p = (uint8_t const *)data;
+        bytes.insert(bytes.end(), p, p + size);
+    }
+
+    void writeString(ObjString * str) {
+        uint32_t length = (uint32_t)str->getLength();
+        write(&length, sizeof(length));
+        write(str->get(), length);
+    }
+};
+
+ChunkCache::ChunkCache(Vm * vm): vm_(vm), mapBase_(nullptr), mapSize_(0) {
+}
+
+ChunkCache::~ChunkCache() {
+    unmap_();
+}
+
+std::string ChunkCache::cachePath(char const * path) {
+    return std::string(path) + "c";
+}
+
+uint32_t ChunkCache::flags_() {
+    return (vm_->getOptimize() ? FLAG_OPTIMIZED_ : 0) | (vm_->getFoldConstants() ? FLAG_FOLDED_ : 0);
+}
+
+bool ChunkCache::map_(char const * path) {
+    int fd = open(path, O_RDONLY);
+    if( fd < 0 ) return false;
+
+    struct stat st;
+    if( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header) ){
+        close(fd);
+        return false;
+    }
+
+    // Private and writable: the Vm may patch the bytecode it runs, which must never
+    // reach the file
+    void * base = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if( base == MAP_FAILED ) return false;
+
+    mapBase_ = (uint8_t *)base;
+    mapSize_ = (size_t)st.st_size;
+    return true;
+}
+
+void ChunkCache::unmap_() {
+    if( mapBase_ != nullptr ){
+        munmap(mapBase_, mapSize_);
+        mapBase_ = nullptr;
+        mapSize_ = 0;
+    }
+}
+
+bool ChunkCache::isFresh_(Header const & header, char const * path) {
+    if( memcmp(header.magic, MAGIC_, sizeof(MAGIC_)) != 0 ) return false;
+    if( header.version != VERSION || header.flags != flags_() ) return false;
+
+    struct stat st;
+    if( stat(path, &st) != 0 ) return false;
+    if( (uint64_t)st.st_size != header.sourceSize ) return false;
+    if( mtimeNs_(st) == header.sourceMtime ) return true;
+
+    // Touched, but maybe not changed: compare the contents
+    FILE * file = fopen(path, "rb");
+    if( file == nullptr ) return false;
+    FileSource fileSource(file);
+    HashingSource source(&fileSource);
+    char buffer[4096];
+    while( source.read(buffer, sizeof(buffer)) > 0 ){
+    }
+    fclose(file);
+    if( source.getHash() != header.sourceHash ) return false;
+
+    // Unchanged: store the new mtime (best effort) so later loads don't hash it again
+    int fd = open(cachePath(path).c_str(), O_WRONLY);
+    if( fd >= 0 ){
+        int64_t mtime = mtimeNs_(st);
+        pwrite(fd, &mtime, sizeof(mtime), offsetof(Header, sourceMtime));
+        close(fd);
+    }
+    return true;
+}
+
+bool ChunkCache::load(char const * path, Chunk & chunk) {
+    if( !map_(cachePath(path).c_str()) ) return false;
+
+    Header header;
+    memcpy(&header, mapBase_, sizeof(header));
+    if( !isFresh_(header, path) ){
+        unmap_();
+        return false;
+    }
+
+    Reader reader{mapBase_ + sizeof(Header), mapBase_ + mapSize_};
+    uint8_t * code = mapBase_ + sizeof(Header);
+    if( (size_t)(reader.end - reader.pos) < header.codeCount ){
+        unmap_();
+        return false;
+    }
+    reader.pos += header.codeCount;
+
+    // Line table:
+    for( uint32_t i = 0; i < header.numLines; ++i ){
+        uint32_t entry[2];  // start, line
+        if( !reader.read(entry, sizeof(entry)) ){
+            unmap_();
+            return false;
+        }
+        chunk.lines.push_back(LineNum{(int)entry[0], (int)entry[1]});
+    }
+    if( header.codeCount > 0 && (chunk.lines.empty() || chunk.lines[0].start != 0) ){
+        unmap_();
+        return false;
+    }
+    if( header.maxStack > (uint32_t)Vm::STACK_MAX ){
+        unmap_();
+        return false;
+    }
+    chunk.setMaxStack((int)header.maxStack);
+
+    // Globals: the bytecode has the slot numbers baked in, so they must come out the same
+    for( uint32_t i = 0; i < header.numGlobals; ++i ){
+        char const * chars;
+        uint32_t length;
+        if( !reader.readString(chars, length) ||
+            vm_->getGlobalSlot(ObjString::newString(vm_, chars, (int)length)) != (int)i ){
+            unmap_();
+            return false;
+        }
+    }
+
+    // Constants (kept alive by the chunk while more strings are allocated):
+    vm_->trackChunk(&chunk);
+    bool ok = true;
+    for( uint32_t i = 0; ok && i < header.numConstants; ++i ){
+        uint8_t tag;
+        ok = reader.read(&tag, sizeof(tag));
+        if( !ok ) break;
+        switch( tag ){
+            case CONST_NIL_:   chunk.addConstant(Value::nil()); break;
+            case CONST_FALSE_: chunk.addConstant(Value::boolean(false)); break;
+            case CONST_TRUE_:  chunk.addConstant(Value::boolean(true)); break;
+            case CONST_NUMBER_: {
+                double number;
+                ok = reader.read(&number, sizeof(number));
+                if( ok ) chunk.addConstant(Value::number(number));
+                break;
+            }
+            case CONST_INTEGER_: {
+                int64_t integer;
+                ok = reader.read(&integer, sizeof(integer));
+                if( ok ) chunk.addConstant(integerValue(vm_, integer));
+                break;
+            }
+            case CONST_STRING_: {
+                char const * chars;
+                uint32_t length;
+                ok = reader.readString(chars, length);
+                if( ok ) chunk.addConstant(Value::object(ObjString::newString(vm_, chars, (int)length)));
+                break;
+            }
+            default:
+                ok = false;
+        }
+    }
+    if( !ok || chunk.numConstants() != (int)header.numConstants ){
+        unmap_();
+        return false;
+    }
+
+    if( !verifyCode_(code, header.codeCount, header.numConstants, header.numGlobals, header.maxStack) ){
+        unmap_();
+        return false;
+    }
+
+    chunk.setExternalCode(code, (int)header.codeCount);
+    return true;
+}
+
+bool ChunkCache::save(char const * path, uint64_t sourceHash, Chunk & chunk) {
+    struct stat st;
+    if( stat(path, &st) != 0 ) return false;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC_, sizeof(MAGIC_));
+    header.version = VERSION;
+    header.flags = flags_();
+    header.codeCount = (uint32_t)chunk.count();
+    header.sourceHash = sourceHash;
+    header.sourceSize = (uint64_t)st.st_size;
+    header.sourceMtime = mtimeNs_(st);
+    header.numLines = (uint32_t)chunk.lines.size();
+    header.numConstants = (uint32_t)chunk.numConstants();
+    header.numGlobals = (uint32_t)vm_->numGlobals();
+    header.maxStack = (uint32_t)chunk.getMaxStack();
+
+    Writer writer;
+    writer.write(&header, sizeof(header));
+    writer.write(chunk.getCode(), header.codeCount);
+    for( LineNum const & run : chunk.lines ){
+        uint32_t entry[2] = {(uint32_t)run.start, (uint32_t)run.line};
+        writer.write(entry, sizeof(entry));
+    }
+    for( int i = 0; i < vm_->numGlobals(); ++i ){
+        writer.writeString(vm_->getGlobalName(i));
+    }
+    for( int i = 0; i < chunk.numConstants(); ++i ){
+        Value value = chunk.getConstant(i);
+        uint8_t tag;
+        if( value.isNil() ){
+            tag = CONST_NIL_;
+            writer.write(&tag, sizeof(tag));
+        }else if( value.isBoolean() ){
+            tag = value.asBoolean() ? CONST_TRUE_ : CONST_FALSE_;
+            writer.write(&tag, sizeof(tag));
+        }else if( value.isNumber() ){
+            tag = CONST_NUMBER_;
+            double number = value.asNumber();
+            writer.write(&tag, sizeof(tag));
+            writer.write(&number, sizeof(number));
+        }else if( value.isAnyInteger() ){
+            tag = CONST_INTEGER_;
+            int64_t integer = value.toInteger();
+            writer.write(&tag, sizeof(tag));
+            writer.write(&integer, sizeof(integer));
+        }else if( value.isString() ){
+            tag = CONST_STRING_;
+            writer.write(&tag, sizeof(tag));
+            writer.writeString(value.asObjString());
+        }else{
+            return false;  // no way to serialise it
+        }
+    }
+
+    // Write to a temporary file and rename, so a reader never sees a partial cache. The
+    // temporary file is unique to this process, so runs saving the same cache at once
+    // can't interleave their writes (the last rename wins, with a whole file)
+    std::string cache = cachePath(path);
+    std::string temp = cache + ".XXXXXX";
+    int fd = mkstemp(&temp[0]);
+    if( fd < 0 ) return false;
+    FILE * file = fdopen(fd, "wb");
+    if( file == nullptr ){
+        close(fd);
+        unlink(temp.c_str());
+        return false;
+    }
+    bool ok = fchmod(fd, 0644) == 0;  // mkstemp makes it private to the owner
+    ok = ok && fwrite(writer.bytes.data(), 1, writer.bytes.size(), file) == writer.bytes.size();
+    ok = (fclose(file) == 0) && ok;
+    if( !ok || rename(temp.c_str(), cache.c_str()) != 0 ){
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+HashingSource::HashingSource(Source * source): source_(source), hash_(ChunkCache::HASH_SEED) {
+}
+
+size_t HashingSource::read(char * buffer, size_t size) {
+    size_t count = source_->read(buffer, size);
+    hash_ = ChunkCache::hashSource(buffer, count, hash_);
+    return count;
+}
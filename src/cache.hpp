@@ -0,0 +1,91 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "source.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class Vm;
+
+/**
+ * On-disk cache of compiled bytecode, so a script which hasn't changed since it was
+ * last run doesn't have to be scanned and compiled again.
+ *
+ * The cache for `script.pond` is written next to it as `script.pondc`:
+ *
+ *   header     magic, format version, compile flags, the source's hash, size and mtime,
+ *              and the chunk's maximum stack depth
+ *   code       raw bytecode (mapped and run in place)
+ *   lines      run-length line table: (start offset, line) pairs
+ *   constants  tagged values; strings are re-interned on load
+ *   globals    names of the global slots the bytecode refers to, in slot order
+ *
+ * Everything is stored in native byte order: a cache is only ever read back by the
+ * machine which wrote it.
+ */
+class ChunkCache {
+public:
+    ChunkCache(Vm * vm);
+
+    // Unmaps the loaded file: chunks loaded from it can't be run afterwards
+    ~ChunkCache();
+
+    /**
+     * Load the cached bytecode for the script at `path` into an empty chunk.
+     * Fails if there is no cache, or it is stale (source changed, different format
+     * version or compile flags), or its global slots don't match the Vm's, or its
+     * bytecode isn't something the compiler could have written (a corrupt file).
+     * A chunk which failed to load may be partly filled in and should be discarded.
+     */
+    bool load(char const * path, Chunk & chunk);
+
+    /**
+     * Write the cache for the script at `path`, given the hash of the source it was
+     * compiled from (see HashingSource)
+     * NOTE: the chunk must have been compiled by this Vm, with no globals defined beforehand
+     */
+    bool save(char const * path, uint64_t sourceHash, Chunk & chunk);
+
+    // Path of the cache file for a script
+    static std::string cachePath(char const * path);
+
+    // Hash of source code used to key the cache: continue from `hash` to hash in pieces
+    static uint64_t hashSource(char const * source, size_t length, uint64_t hash = HASH_SEED);
+
+    static uint64_t const HASH_SEED = 14695981039346656037ull;
+
+    static uint32_t const VERSION = 6;  // bump whenever the bytecode or file layout changes
+
+private:
+    struct Header;
+
+    bool map_(char const * path);
+    void unmap_();
+    bool isFresh_(Header const & header, char const * path);
+    uint32_t flags_();
+
+    Vm * vm_;
+    uint8_t * mapBase_;
+    size_t mapSize_;
+};
+
+/**
+ * Passes a source through to the scanner, hashing it on the way so the compiled
+ * chunk can be cached without reading the source twice
+ */
+class HashingSource: public Source {
+public:
+    HashingSource(Source * source);
+
+    virtual ~HashingSource() {}
+
+    virtual size_t read(char * buffer, size_t size) override;
+
+    uint64_t getHash() const { return hash_; }
+
+private:
+    Source * source_;
+    uint64_t hash_;
+};
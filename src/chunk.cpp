@@ -1,53 +1,173 @@
 
 #include "chunk.hpp"
+#include "jit.hpp"
+#include "vm.hpp"
 
+#include <assert.h>
 #include <stdlib.h>  // exit
 
 
-static int const MAX_COUNT_ = 65535;
+static int const MAX_COUNT_ = 1 << 30;
 
-Chunk::Chunk() {
+int OpCode::instructionLength(uint8_t op) {
+    switch( op ){
+        case OpCode::CONSTANT:
+        case OpCode::DEFINE_GLOBAL:
+        case OpCode::GET_GLOBAL:
+        case OpCode::SET_GLOBAL:
+        case OpCode::SET_GLOBAL_POP:
+            return 2;
+        case OpCode::ADD_GLOBAL_CONST:
+        case OpCode::SUBTRACT_GLOBAL_CONST:
+        case OpCode::LESS_GLOBAL_CONST:
+        case OpCode::DEFINE_GLOBAL_CONST:
+            return 3;
+        case OpCode::CONSTANT_LONG:
+        case OpCode::DEFINE_GLOBAL_LONG:
+        case OpCode::GET_GLOBAL_LONG:
+        case OpCode::SET_GLOBAL_LONG:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+int OpCode::stackEffect(uint8_t op) {
+    switch( op ){
+        case OpCode::CONSTANT:
+        case OpCode::CONSTANT_LONG:
+        case OpCode::NIL:
+        case OpCode::TRUE:
+        case OpCode::FALSE:
+        case OpCode::GET_GLOBAL:
+        case OpCode::GET_GLOBAL_LONG:
+        case OpCode::ADD_GLOBAL_CONST:
+        case OpCode::SUBTRACT_GLOBAL_CONST:
+        case OpCode::LESS_GLOBAL_CONST:
+            return 1;
+        case OpCode::POP:
+        case OpCode::DEFINE_GLOBAL:
+        case OpCode::DEFINE_GLOBAL_LONG:
+        case OpCode::PRINT:
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+        case OpCode::ADD:
+        case OpCode::SUBTRACT:
+        case OpCode::MULTIPLY:
+        case OpCode::DIVIDE:
+        case OpCode::ADD_NUM:
+        case OpCode::ADD_STR:
+        case OpCode::SUBTRACT_NUM:
+        case OpCode::MULTIPLY_NUM:
+        case OpCode::DIVIDE_NUM:
+        case OpCode::GREATER_NUM:
+        case OpCode::GREATER_EQUAL_NUM:
+        case OpCode::LESS_NUM:
+        case OpCode::LESS_EQUAL_NUM:
+        case OpCode::ADD_INT:
+        case OpCode::SUBTRACT_INT:
+        case OpCode::MULTIPLY_INT:
+        case OpCode::GREATER_INT:
+        case OpCode::GREATER_EQUAL_INT:
+        case OpCode::LESS_INT:
+        case OpCode::LESS_EQUAL_INT:
+        case OpCode::SET_GLOBAL_POP:
+            return -1;
+        default:
+            return 0;  // SET_GLOBAL (leaves the value), DEFINE_GLOBAL_CONST, unary operators, RETURN
+    }
+}
+
+Chunk::Chunk(): externalCode(nullptr), externalCount(0), maxStack(0), jitCode(nullptr), runs(0), vm(nullptr) {
 }
 
 Chunk::~Chunk() {
+    if( vm != nullptr ) vm->untrackChunk(this);
+    delete jitCode;
+}
+
+void Chunk::setJitCode(JitCode * code) {
+    delete jitCode;
+    jitCode = code;
 }
 
-void Chunk::write(uint8_t byte, uint16_t line) {
+void Chunk::write(uint8_t byte, int line) {
+    assert(externalCode == nullptr);
+    if( jitCode != nullptr ) setJitCode(nullptr);
     if( code.size() >= MAX_COUNT_ ){
         // TODO fatal error
         exit(1);
     }
+    // start a new run when the line changes:
+    if( lines.empty() || lines.back().line != line ){
+        lines.push_back(LineNum{(int)code.size(), line});
+    }
     code.push_back(byte);
-    lines.push_back(line);
 }
 
-uint16_t Chunk::getLineNumber(int offset) {
-    if( offset < 0 || offset >= (int)lines.size() ) return -1;  // should never happen
-    return lines[offset];
+void Chunk::truncate(int count, int numConstants) {
+    if( jitCode != nullptr ) setJitCode(nullptr);
+    code.resize((size_t)count);
+    while( !lines.empty() && lines.back().start >= count ){
+        lines.pop_back();
+    }
+    for( size_t i = (size_t)numConstants; i < constants.size(); ++i ){
+        constantIndex.erase(constants[i]);
+    }
+    constants.resize((size_t)numConstants);
+}
+
+int Chunk::getLineNumber(int offset) {
+    if( offset < 0 || offset >= count() ) return -1;  // should never happen
+
+    // find the last run starting at or before offset:
+    int lo = 0;
+    int hi = (int)lines.size() - 1;
+    while( lo < hi ){
+        int mid = (lo + hi + 1) / 2;
+        if( lines[mid].start <= offset ){
+            lo = mid;
+        }else{
+            hi = mid - 1;
+        }
+    }
+    return lines[lo].line;
 }
 
 int Chunk::count() {
+    if( externalCode != nullptr ) return externalCount;
     return (int)code.size();
 }
 
 uint8_t * Chunk::getCode() {
-    return &code[0];
+    if( externalCode != nullptr ) return externalCode;
+    return code.data();
 }
 
-uint8_t Chunk::addConstant(Value value) {
+void Chunk::setExternalCode(uint8_t * code, int count) {
+    externalCode = code;
+    externalCount = count;
+}
+
+int Chunk::addConstant(Value value) {
+    // reuse an identical constant if there is one (in the same lookup as adding it)
     int size = (int)constants.size();
-    if( size < MAX_CONSTANTS ){
-        constants.push_back(value);
-        return (uint8_t)size; // index of new constant
-    }else{
+    auto inserted = constantIndex.emplace(value, size);
+    if( !inserted.second ) return inserted.first->second;
+
+    if( size >= MAX_CONSTANTS ){
+        constantIndex.erase(inserted.first);
         return MAX_CONSTANTS; // full!
     }
-}
 
-Value Chunk::getConstant(uint8_t index) {
-    return constants[index];
+    constants.push_back(value);
+    return size; // index of new constant
 }
 
-uint8_t Chunk::numConstants() {
-    return (uint8_t)constants.size();
+int Chunk::numConstants() {
+    return (int)constants.size();
 }
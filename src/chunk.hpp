@@ -5,6 +5,10 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <vector>
+#include <unordered_map>
+
+class JitCode;
+class Vm;
 
 namespace OpCode {
 enum {
@@ -14,9 +18,9 @@ enum {
     TRUE,           // Push true to the stack
     FALSE,          // Push false to the stack
     POP,            // Pop 1 value from the stack
-    DEFINE_GLOBAL,  // Define a global variable
-    GET_GLOBAL,     // Push the value of a global to the stack
-    SET_GLOBAL,     // Set the value of a variable
+    DEFINE_GLOBAL,  // Define a global variable (operand is the global's slot)
+    GET_GLOBAL,     // Push the value of a global to the stack (operand is the global's slot)
+    SET_GLOBAL,     // Set the value of a variable (operand is the global's slot)
     // Binary operators: take two values from the stack and push one:
     EQUAL,
     NOT_EQUAL,
@@ -34,12 +38,60 @@ enum {
     // Control flow:
     PRINT,
     RETURN,
+    // Wide variants with a 24-bit operand:
+    CONSTANT_LONG,
+    DEFINE_GLOBAL_LONG,
+    GET_GLOBAL_LONG,
+    SET_GLOBAL_LONG,
+    // Quickened variants: never compiled, the Vm rewrites a generic instruction into one
+    // of these once it has seen its operand types, and back again if they change:
+    ADD_NUM,
+    ADD_STR,
+    SUBTRACT_NUM,
+    MULTIPLY_NUM,
+    DIVIDE_NUM,
+    GREATER_NUM,
+    GREATER_EQUAL_NUM,
+    LESS_NUM,
+    LESS_EQUAL_NUM,
+    ADD_INT,
+    SUBTRACT_INT,
+    MULTIPLY_INT,
+    GREATER_INT,
+    GREATER_EQUAL_INT,
+    LESS_INT,
+    LESS_EQUAL_INT,
+    // Superinstructions: common sequences fused into one instruction by the optimizer.
+    // Operands are a global slot then a constant index, a byte each:
+    ADD_GLOBAL_CONST,       // GET_GLOBAL, CONSTANT, ADD
+    SUBTRACT_GLOBAL_CONST,  // GET_GLOBAL, CONSTANT, SUBTRACT
+    LESS_GLOBAL_CONST,      // GET_GLOBAL, CONSTANT, LESS
+    DEFINE_GLOBAL_CONST,    // CONSTANT, DEFINE_GLOBAL
+    SET_GLOBAL_POP,         // SET_GLOBAL, POP (global slot operand only)
 };
+
+// Size of an instruction in bytes, including its operands
+int instructionLength(uint8_t op);
+
+// Change in the operand stack depth from running an instruction
+int stackEffect(uint8_t op);
+
+// Largest operand of the short (single byte operand) instructions
+static int const SHORT_OPERAND_MAX = 255;
 }
 
+// 24-bit operands are stored little endian
+inline int readLongOperand(uint8_t const * bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+}
+
+/**
+ * Run-length encoded line table entry: all bytecode from `start` up to the start
+ * of the next run comes from the same source line
+ */
 struct LineNum {
-    uint16_t line;  // line number
-    uint8_t count;  // number of instructions on the line
+    int start;      // offset of the first byte of the run
+    int line;       // line number
 };
 
 class Chunk {
@@ -48,34 +100,76 @@ public:
 
     ~Chunk();
 
+    // Owns its compiled code and is tracked by address (see Vm::trackChunk): never copied
+    Chunk(Chunk const &) = delete;
+    Chunk & operator=(Chunk const &) = delete;
+
     // append to bytecode array
-    void write(uint8_t byte, uint16_t line);
+    void write(uint8_t byte, int line);
     
+    // Discard bytecode from `count` onwards, and constants from `numConstants` onwards
+    void truncate(int count, int numConstants);
+
     // Get a line number corresponding to position in bytecode array
-    uint16_t getLineNumber(int offset);
+    // NOTE: binary search, intended for error reporting and disassembly
+    int getLineNumber(int offset);
+
+    // Memory used by the line table
+    size_t lineTableBytes(){ return lines.size() * sizeof(LineNum); }
 
     // Get the length of the bytecode array
     int count();
 
     // Get a pointer to the bytecode array
+    // NOTE: writable, the Vm quickens instructions in place as it runs them
     uint8_t * getCode();
 
-    // Add a constant value and return its index
-    uint8_t addConstant(Value value);
+    /**
+     * Run bytecode held outside the chunk (e.g. mapped from a cache file) instead of
+     * the chunk's own array. The memory must be writable and outlive the chunk, and
+     * nothing more may be written to the chunk.
+     */
+    void setExternalCode(uint8_t * code, int count);
+
+    // Add a constant value (or find an identical one already added) and return its index
+    int addConstant(Value value);
 
     // Get a constant value by its index
-    Value getConstant(uint8_t index);
+    Value getConstant(int index){ return constants[(size_t)index]; }
+
+    int numConstants();
+
+    // Native code compiled from this chunk, or nullptr. Discarded if the bytecode is written to
+    JitCode * getJitCode(){ return jitCode; }
+
+    // Give the chunk its compiled code, which it then owns
+    void setJitCode(JitCode * code);
+
+    // Deepest the operand stack gets running the chunk (worked out by the compiler)
+    int getMaxStack(){ return maxStack; }
+    void setMaxStack(int depth){ maxStack = depth; }
 
-    uint8_t numConstants();
+    // Count another run of the chunk (to find hot chunks worth compiling), returning the total
+    int countRun(){ return ++runs; }
 
-    static uint8_t const MAX_CONSTANTS = 255;  // constant index must fit in a byte (for now)
+    static int const MAX_CONSTANTS = 1 << 24;  // constant index must fit in a 24-bit operand
 
 private:
     std::vector<uint8_t> code;
-    std::vector<uint16_t> lines;    // line numbers corresponding to bytecode array
+    uint8_t * externalCode;         // if not null, used instead of code
+    int externalCount;
+    std::vector<LineNum> lines;     // line numbers corresponding to bytecode array (run-length encoded)
     std::vector<Value> constants;
+    std::unordered_map<Value, int, ValueIdentityHash, ValueIdentical> constantIndex;  // value -> index
+    int maxStack;
+    JitCode * jitCode;
+    int runs;
+    Vm * vm;                        // keeping the constants alive (see Vm::trackChunk), or nullptr
 
-    // Disassembler needs access within the chunk:
+    // Disassembler and optimizer need access within the chunk:
     friend class Dissassembler;
+    friend class Vm;
+    friend class Optimizer;
+    friend class ChunkCache;
 };
 
@@ -15,10 +15,24 @@ Compiler::~Compiler() {
 
 bool Compiler::compile(char const * source, Chunk & chunk) {
     scanner_.init(source);
+    return compile_(chunk);
+}
+
+bool Compiler::compile(Source * source, Chunk & chunk) {
+    scanner_.init(source);
+    return compile_(chunk);
+}
+
+bool Compiler::compile_(Chunk & chunk) {
     compilingChunk_ = &chunk;
+    vm_->trackChunk(&chunk);  // keep constants alive while compiling, and after
 
     hadError_ = false;
     panicMode_ = false;
+    lastLiteral_.valid = false;
+    stackDepth_ = 0;
+    operandBytes_ = 0;
+    chunk.setMaxStack(0);
 
     advance_();  // get the first token
     
@@ -37,10 +51,6 @@ void Compiler::advance_() {
     // spin until we get a valid token (or END):
     for(;;) {
         currentToken_ = scanner_.scanToken();
-        if( currentToken_.line == Scanner::MAX_LINES ){
-            fprintf(stderr, "Too many lines");
-            exit(1); // TODO proper error handling
-        }
 
         if( currentToken_.type == Token::ERROR ){
             // report error then ignore and continue
@@ -80,8 +90,23 @@ void Compiler::emitByte_(uint8_t byte) {
     emitByteAtLine_(byte, previousToken_.line);
 }
 
-void Compiler::emitByteAtLine_(uint8_t byte, uint16_t line) {
-    currentChunk_()->write(byte, line);
+void Compiler::emitByteAtLine_(uint8_t byte, int line) {
+    lastLiteral_.valid = false;  // set again by emitLiteral_ if it is one
+    Chunk * chunk = currentChunk_();
+    chunk->write(byte, line);
+
+    // Track the stack depth, so the Vm can size its stack once per run instead of checking
+    // every push (chunks are straight-line code, so the depth at each instruction is fixed):
+    if( operandBytes_ > 0 ){
+        operandBytes_--;
+        return;
+    }
+    operandBytes_ = OpCode::instructionLength(byte) - 1;
+    stackDepth_ += OpCode::stackEffect(byte);
+    if( stackDepth_ > chunk->getMaxStack() ){
+        chunk->setMaxStack(stackDepth_);
+        if( stackDepth_ > Vm::STACK_MAX ) errorAtPrevious_("Expression too deeply nested.");
+    }
 }
 
 void Compiler::endCompilation_() {
@@ -93,23 +118,55 @@ void Compiler::emitReturn_() {
 }
 
 void Compiler::emitTrue_() {
-    emitByte_(OpCode::TRUE);
+    emitLiteral_(Value::boolean(true));
 }
 
 void Compiler::emitFalse_() {
-    emitByte_(OpCode::FALSE);
+    emitLiteral_(Value::boolean(false));
 }
 
 void Compiler::emitNil_() {
-    emitByte_(OpCode::NIL);
+    emitLiteral_(Value::nil());
 }
 
 void Compiler::emitConstant_(Value value) {
-    emitBytes_(OpCode::CONSTANT, makeConstant_(value));
+    emitOperandOp_(OpCode::CONSTANT, OpCode::CONSTANT_LONG, makeConstant_(value));
 }
 
-uint8_t Compiler::makeConstant_(Value value) {
-    uint8_t constant = currentChunk_()->addConstant(value);
+void Compiler::emitOperandOp_(uint8_t op, uint8_t longOp, int operand) {
+    if( operand <= OpCode::SHORT_OPERAND_MAX ){
+        emitBytes_(op, (uint8_t)operand);
+    }else{
+        // 24-bit little endian operand:
+        emitByte_(longOp);
+        emitByte_((uint8_t)(operand & 0xff));
+        emitByte_((uint8_t)((operand >> 8) & 0xff));
+        emitByte_((uint8_t)((operand >> 16) & 0xff));
+    }
+}
+
+void Compiler::emitLiteral_(Value value) {
+    ConstantExpr literal;
+    literal.codeStart = currentChunk_()->count();
+    literal.numConstants = currentChunk_()->numConstants();
+    literal.stackDepth = stackDepth_;
+    literal.value = value;
+
+    if( value.isNil() ){
+        emitByte_(OpCode::NIL);
+    }else if( value.isBoolean() ){
+        emitByte_(value.asBoolean() ? OpCode::TRUE : OpCode::FALSE);
+    }else{
+        emitConstant_(value);
+    }
+
+    literal.codeEnd = currentChunk_()->count();
+    literal.valid = true;
+    lastLiteral_ = literal;
+}
+
+int Compiler::makeConstant_(Value value) {
+    int constant = currentChunk_()->addConstant(value);
     if( constant == Chunk::MAX_CONSTANTS ){
         errorAtPrevious_("Too many constants in one chunk.");
         return 0;
@@ -133,7 +190,7 @@ void Compiler::declaration_() {
 }
 
 void Compiler::varDeclaration_() {
-    uint8_t global = parseVariable_("Expected variable name.");
+    int global = parseVariable_("Expected variable name.");
 
     // assigned an initial value?
     if( match_(Token::EQUAL) ){
@@ -145,8 +202,8 @@ void Compiler::varDeclaration_() {
     defineVariable_(global);
 }
 
-void Compiler::defineVariable_(uint8_t global) {
-    emitBytes_(OpCode::DEFINE_GLOBAL, global);
+void Compiler::defineVariable_(int global) {
+    emitOperandOp_(OpCode::DEFINE_GLOBAL, OpCode::DEFINE_GLOBAL_LONG, global);
 }
 
 void Compiler::statement_() {
@@ -199,7 +256,7 @@ void Compiler::parse_(Precedence precedence) {
     }
     // Check whether assignment is possible and pass down to the rule (if it cares)
     bool canAssign = precedence <= Precedence::ASSIGNMENT;
-    prefixRule(canAssign);
+    prefixRule(this, canAssign);
 
     // Perforce infix rules on tokens from left to right:
     for( ;; ){
@@ -210,7 +267,7 @@ void Compiler::parse_(Precedence precedence) {
         }
         // Consume and then compile the operator:
         advance_();
-        rule->infix(canAssign);  // Can't be NULL as Precedence > NONE (refer getRule_ table)
+        rule->infix(this, canAssign);  // Can't be NULL as Precedence > NONE (refer getRule_ table)
     }
     // handle a case where assignment is badly placed, otherwise this isn't handled!
     if( canAssign && match_(Token::EQUAL) ){
@@ -218,16 +275,20 @@ void Compiler::parse_(Precedence precedence) {
     }
 }
 
-uint8_t Compiler::parseVariable_(const char * errorMsg) {
+int Compiler::parseVariable_(const char * errorMsg) {
     consume_( Token::IDENTIFIER, errorMsg );
 
-    return makeIdentifierConstant_(previousToken_);
+    return identifierSlot_(previousToken_);
 }
 
-uint8_t Compiler::makeIdentifierConstant_(Token & name) {
-    return makeConstant_(Value::object(
-        ObjString::newString(vm_, name.start, name.length)
-    ));
+int Compiler::identifierSlot_(Token & name) {
+    // globals are resolved to a slot at compile time, so the name is never hashed at runtime
+    int slot = vm_->getGlobalSlot(ObjString::newString(vm_, name.start, name.length));
+    if( slot < 0 ){
+        errorAtPrevious_("Too many global variables.");
+        return 0;
+    }
+    return slot;
 }
 
 void Compiler::grouping_() {
@@ -240,11 +301,20 @@ void Compiler::grouping_() {
 
 void Compiler::unary_() {
     Token::Type operatorType = previousToken_.type;
-    uint16_t line = previousToken_.line;
+    int line = previousToken_.line;
+    int operandStart = currentChunk_()->count();
 
     // Compile the operand evaluation first:
     parse_(Precedence::UNARY);
 
+    // Evaluate now if the operand is a literal:
+    Value result;
+    if( vm_->getFoldConstants() && lastLiteral_.valid && lastLiteral_.codeStart == operandStart &&
+        foldUnary_(operatorType, lastLiteral_.value, result) ){
+        replaceWithLiteral_(lastLiteral_, result);
+        return;
+    }
+
     // Result of the operand gets negated:
     switch( operatorType ){
         case Token::BANG:  emitByteAtLine_(OpCode::NOT, line); break;
@@ -258,11 +328,21 @@ void Compiler::binary_() {
     // the first operand is already compiled and will end up on the stack first
     Token::Type operatorType = previousToken_.type;
     ParseRule const * rule = getRule_(operatorType);
+    ConstantExpr first = lastLiteral_;
 
     // parse the second operand, and stop when the precendence is equal or lower
     // stopping when precedence is equal causes math to be left associative: 1+2+3 = (1+2)+3
     parse_((Precedence)((int)rule->precedence + 1));
 
+    // Evaluate now if both operands are literals, directly following each other:
+    ConstantExpr second = lastLiteral_;
+    Value result;
+    if( vm_->getFoldConstants() && first.valid && second.valid && second.codeStart == first.codeEnd &&
+        foldBinary_(operatorType, first.value, second.value, result) ){
+        replaceWithLiteral_(first, result);
+        return;
+    }
+
     // now both operand values will end up on the stack. combine them:
     switch( operatorType ){
         case Token::BANG_EQUAL:    emitByte_(OpCode::NOT_EQUAL); break;
@@ -279,15 +359,77 @@ void Compiler::binary_() {
     }
 }
 
+bool Compiler::foldUnary_(Token::Type operatorType, Value operand, Value & result) {
+    switch( operatorType ){
+        case Token::BANG:
+            result = Value::boolean(!operand.isTruthy());
+            return true;
+        case Token::MINUS:
+            if( operand.isAnyInteger() ){
+                result = negateInteger(vm_, operand.toInteger());
+                return true;
+            }
+            if( !operand.isNumber() ) return false;  // leave the error for runtime
+            result = Value::number(-operand.asNumber());
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool Compiler::foldBinary_(Token::Type operatorType, Value a, Value b, Value & result) {
+    // Mirrors the Vm: any combination which would be a runtime error is left for the Vm
+    switch( operatorType ){
+        case Token::EQUAL_EQUAL: result = Value::boolean(a.equals(b)); return true;
+        case Token::BANG_EQUAL:  result = Value::boolean(!a.equals(b)); return true;
+        case Token::PLUS:
+            if( a.isString() ){
+                // implicitly convert second operand to string (keep it reachable while concatenating)
+                ObjString * bStr = b.toString(vm_);
+                vm_->push(Value::object(bStr));
+                result = Value::object(ObjString::concatenate(vm_, a.asObjString(), bStr));
+                vm_->pop();
+                return true;
+            }
+            break;
+        default: break;
+    }
+
+    uint8_t op;
+    switch( operatorType ){
+        case Token::GREATER:       op = OpCode::GREATER; break;
+        case Token::GREATER_EQUAL: op = OpCode::GREATER_EQUAL; break;
+        case Token::LESS:          op = OpCode::LESS; break;
+        case Token::LESS_EQUAL:    op = OpCode::LESS_EQUAL; break;
+        case Token::PLUS:          op = OpCode::ADD; break;
+        case Token::MINUS:         op = OpCode::SUBTRACT; break;
+        case Token::STAR:          op = OpCode::MULTIPLY; break;
+        case Token::SLASH:         op = OpCode::DIVIDE; break;
+        default:                   return false;
+    }
+    return vm_->numericBinary(op, a, b, result);
+}
+
+void Compiler::replaceWithLiteral_(ConstantExpr const & first, Value result) {
+    // drop the operand instructions, and any constants they added, then emit the result instead:
+    currentChunk_()->truncate(first.codeStart, first.numConstants);
+    stackDepth_ = first.stackDepth;
+    emitLiteral_(result);
+}
+
+void Compiler::integer_() {
+    // the scanner has already parsed it (boxing it if it doesn't fit inline)
+    emitLiteral_(integerValue(vm_, previousToken_.integer));
+}
+
 void Compiler::number_() {
-    // shouldn't fail as we already validated the token as a number:
-    double n = strtod(previousToken_.start, nullptr);
-    emitConstant_(Value::number(n));
+    // the scanner has already parsed it:
+    emitLiteral_(Value::number(previousToken_.number));
 }
 
 void Compiler::string_() {
     ObjString * str = ObjString::newString(vm_, previousToken_.start+1, previousToken_.length-2);
-    emitConstant_(Value::object(str));
+    emitLiteral_(Value::object(str));
 }
 
 void Compiler::variable_(bool canAssign) {
@@ -295,23 +437,24 @@ void Compiler::variable_(bool canAssign) {
 }
 
 void Compiler::namedVariable_(Token token, bool canAssign) {
-    uint8_t global = makeIdentifierConstant_(token);
+    int global = identifierSlot_(token);
 
     // identify whether we are setting or getting a variable:
     if( canAssign && match_(Token::EQUAL) ){
         // setting
         expression_();  // the value to set
-        emitBytes_(OpCode::SET_GLOBAL, global);
+        emitOperandOp_(OpCode::SET_GLOBAL, OpCode::SET_GLOBAL_LONG, global);
     }else{
         // getting
-        emitBytes_(OpCode::GET_GLOBAL, global);
+        emitOperandOp_(OpCode::GET_GLOBAL, OpCode::GET_GLOBAL_LONG, global);
     }
 }
 
 
 // Macros to define lambdas to call each function with or without parameter `canAssign`
-#define ASSIGNMENT_RULE(fn) [this](bool canAssign){ this->fn(canAssign); }
-#define RULE(fn) [this](bool canAssign){ (void) canAssign; this->fn(); }
+// The table is shared by all compilers, so the rules take the compiler to run on
+#define ASSIGNMENT_RULE(fn) [](Compiler * c, bool canAssign){ c->fn(canAssign); }
+#define RULE(fn) [](Compiler * c, bool canAssign){ (void) canAssign; c->fn(); }
 
 ParseRule const * Compiler::getRule_(Token::Type type) {
     static const ParseRule rules[] = {
@@ -337,6 +480,7 @@ ParseRule const * Compiler::getRule_(Token::Type type) {
         [Token::IDENTIFIER]    = {ASSIGNMENT_RULE(variable_), NULL,  Precedence::NONE},
         [Token::STRING]        = {RULE(string_),   NULL,          Precedence::NONE},
         [Token::NUMBER]        = {RULE(number_),   NULL,          Precedence::NONE},
+        [Token::INTEGER]       = {RULE(integer_),  NULL,          Precedence::NONE},
         [Token::AND]           = {NULL,            NULL,          Precedence::NONE},
         [Token::ELSE]          = {NULL,            NULL,          Precedence::NONE},
         [Token::FALSE]         = {RULE(emitFalse_),NULL,          Precedence::NONE},
@@ -2,7 +2,6 @@
 
 #include "chunk.hpp"
 #include "scanner.hpp"
-#include <functional>
 
 class Vm;
 
@@ -22,13 +21,29 @@ enum class Precedence {
 };
 
 // Parse rule to define how to parse each token:
+class Compiler;
+typedef void (*ParseFn)(Compiler * compiler, bool canAssign);
+
 struct ParseRule {
-    std::function<void(bool)> prefix;
-    std::function<void(bool)> infix;
+    ParseFn prefix;
+    ParseFn infix;
     Precedence precedence;
 };
 
 
+/**
+ * Record of an expression which compiled to a single literal instruction,
+ * so that operators applied to it can be evaluated at compile time
+ */
+struct ConstantExpr {
+    bool valid;        // false if the last thing emitted wasn't a literal
+    int codeStart;     // offset of the literal instruction
+    int codeEnd;       // offset just past the literal instruction
+    int numConstants;  // size of the constant pool before the literal was emitted
+    int stackDepth;    // operand stack depth before the literal was emitted
+    Value value;
+};
+
 class Compiler {
 public:
     Compiler(Vm * vm);
@@ -41,7 +56,16 @@ public:
     */
     bool compile(char const * source, Chunk & chunk);
 
+    /**
+     * Compile a stream of source code, without holding it all in memory
+     * @param source [input]
+     * @param chunk [output]
+    */
+    bool compile(Source * source, Chunk & chunk);
+
 private:
+    bool compile_(Chunk & chunk);
+
     // parser helpers:
     void advance_();
     void consume_(Token::Type type, const char* message);
@@ -53,11 +77,12 @@ private:
     void expression_();
     void declaration_();
     void varDeclaration_();
-    void defineVariable_(uint8_t global);
+    void defineVariable_(int global);
     void statement_();
     void synchronise_();
     void parse_(Precedence precedence);  // parse expressions with >= precendence
-    uint8_t parseVariable_(const char * errorMsg);
+    int parseVariable_(const char * errorMsg);
+    void integer_();
     void number_();
     void string_();
     void variable_(bool canAssign);
@@ -68,7 +93,7 @@ private:
 
     // bytecode helpers:
     void emitByte_(uint8_t byte);
-    void emitByteAtLine_(uint8_t byte, uint16_t line);
+    void emitByteAtLine_(uint8_t byte, int line);
     inline void emitBytes_(uint8_t b1, uint8_t b2){ emitByte_(b1); emitByte_(b2); }
     void endCompilation_();
     void emitTrue_();
@@ -76,8 +101,15 @@ private:
     void emitNil_();
     void emitReturn_();
     void emitConstant_(Value value);
-    uint8_t makeConstant_(Value value);
-    uint8_t makeIdentifierConstant_(Token & name);
+    void emitLiteral_(Value value);
+    void emitOperandOp_(uint8_t op, uint8_t longOp, int operand);  // picks the short or long form
+    int makeConstant_(Value value);
+
+    // constant folding:
+    bool foldUnary_(Token::Type operatorType, Value operand, Value & result);
+    bool foldBinary_(Token::Type operatorType, Value a, Value b, Value & result);
+    void replaceWithLiteral_(ConstantExpr const & first, Value result);
+    int identifierSlot_(Token & name);
 
     // error production:
     void errorAtCurrent_(const char* message);
@@ -91,4 +123,7 @@ private:
     Token previousToken_;
     bool hadError_;
     bool panicMode_;
+    ConstantExpr lastLiteral_;  // the last emitted instruction, if it was a literal
+    int stackDepth_;            // operand stack depth after the instructions emitted so far
+    int operandBytes_;          // operand bytes still to come for the last instruction emitted
 };
\ No newline at end of file
@@ -1,11 +1,15 @@
 
 #include "debug.hpp"
+#include "vm.hpp"
 
 #include <stdio.h>
 #include <stdlib.h>
 
 
-Dissassembler::Dissassembler(){
+Dissassembler::Dissassembler(): vm_(nullptr) {
+}
+
+Dissassembler::Dissassembler(Vm * vm): vm_(vm) {
 }
 
 Dissassembler::~Dissassembler(){
@@ -30,42 +34,70 @@ int Dissassembler::disassembleInstruction_(Chunk * chunk, int offset, int line){
     printf("%04i ", offset);
     printf("%4d ", line);
 
-    uint8_t instr = chunk->code[(size_t)offset];
+    uint8_t instr = chunk->getCode()[offset];
+    char const * name = opCodeToStr(instr);
+    if( name == nullptr ){
+        printf("Unknown opcode %i\n", instr);
+        return 1;
+    }
     switch(instr){
-        case OpCode::CONSTANT:      return constantInstruction_("CONSTANT", chunk, offset);
-        case OpCode::NIL:           return simpleInstruction_("NIL");
-        case OpCode::TRUE:          return simpleInstruction_("TRUE");
-        case OpCode::FALSE:         return simpleInstruction_("FALSE");
-        case OpCode::ADD:           return simpleInstruction_("ADD");
-        case OpCode::POP:           return simpleInstruction_("POP");
-        case OpCode::DEFINE_GLOBAL: return constantInstruction_("DEFINE_GLOBAL", chunk, offset);
-        case OpCode::GET_GLOBAL:    return constantInstruction_("GET_GLOBAL", chunk, offset);
-        case OpCode::SET_GLOBAL:    return constantInstruction_("SET_GLOBAL", chunk, offset);
-        case OpCode::EQUAL:         return simpleInstruction_("EQUAL"); 
-        case OpCode::NOT_EQUAL:     return simpleInstruction_("NOT_EQUAL");     
-        case OpCode::GREATER:       return simpleInstruction_("GREATER");   
-        case OpCode::GREATER_EQUAL: return simpleInstruction_("GREATER_EQUAL");         
-        case OpCode::LESS:          return simpleInstruction_("LESS"); 
-        case OpCode::LESS_EQUAL:    return simpleInstruction_("LESS_EQUAL");  
-        case OpCode::SUBTRACT:      return simpleInstruction_("SUBTRACT");
-        case OpCode::MULTIPLY:      return simpleInstruction_("MULTIPLY");
-        case OpCode::DIVIDE:        return simpleInstruction_("DIVIDE");
-        case OpCode::NEGATE:        return simpleInstruction_("NEGATE");
-        case OpCode::NOT:           return simpleInstruction_("NOT");
-        case OpCode::PRINT:         return simpleInstruction_("PRINT");
-        case OpCode::RETURN:        return simpleInstruction_("RETURN");
+        case OpCode::CONSTANT:
+        case OpCode::CONSTANT_LONG:
+            return constantInstruction_(name, chunk, offset);
+        case OpCode::DEFINE_GLOBAL:
+        case OpCode::GET_GLOBAL:
+        case OpCode::SET_GLOBAL:
+        case OpCode::DEFINE_GLOBAL_LONG:
+        case OpCode::GET_GLOBAL_LONG:
+        case OpCode::SET_GLOBAL_LONG:
+        case OpCode::SET_GLOBAL_POP:
+            return globalInstruction_(name, chunk, offset);
+        case OpCode::ADD_GLOBAL_CONST:
+        case OpCode::SUBTRACT_GLOBAL_CONST:
+        case OpCode::LESS_GLOBAL_CONST:
+        case OpCode::DEFINE_GLOBAL_CONST:
+            return globalConstantInstruction_(name, chunk, offset);
         default:
-            printf("Unknown opcode %i\n", instr);
-            return 1;
+            return simpleInstruction_(name);
     }
 }
 
+int Dissassembler::operand_(Chunk * chunk, int offset){
+    if( OpCode::instructionLength(chunk->getCode()[offset]) == 4 ){
+        return readLongOperand(chunk->getCode() + offset + 1);
+    }
+    return chunk->getCode()[offset + 1];
+}
+
 int Dissassembler::constantInstruction_(char const * name, Chunk * chunk, int offset){
-    uint8_t constantIdx = chunk->code[offset + 1];
+    int constantIdx = operand_(chunk, offset);
     printf("%-16s %4d '", name, constantIdx);
     chunk->constants[constantIdx].print();
     printf("'\n");
-    return 2;
+    return OpCode::instructionLength(chunk->getCode()[offset]);
+}
+
+int Dissassembler::globalInstruction_(char const * name, Chunk * chunk, int offset){
+    int slot = operand_(chunk, offset);
+    printf("%-16s %4d", name, slot);
+    if( vm_ != nullptr ){
+        printf(" '%s'", vm_->getGlobalName(slot)->get());
+    }
+    printf("\n");
+    return OpCode::instructionLength(chunk->getCode()[offset]);
+}
+
+int Dissassembler::globalConstantInstruction_(char const * name, Chunk * chunk, int offset){
+    int slot = chunk->getCode()[offset + 1];
+    int constantIdx = chunk->getCode()[offset + 2];
+    printf("%-16s %4d", name, slot);
+    if( vm_ != nullptr ){
+        printf(" '%s'", vm_->getGlobalName(slot)->get());
+    }
+    printf(" %4d '", constantIdx);
+    chunk->constants[constantIdx].print();
+    printf("'\n");
+    return OpCode::instructionLength(chunk->getCode()[offset]);
 }
 
 int Dissassembler::simpleInstruction_(char const * name){
@@ -93,6 +125,59 @@ void debugScanner(char const * source) {
     }
 }
 
+char const * opCodeToStr(uint8_t op) {
+    switch( op ){
+        case OpCode::CONSTANT:          return "CONSTANT";
+        case OpCode::NIL:               return "NIL";
+        case OpCode::TRUE:              return "TRUE";
+        case OpCode::FALSE:             return "FALSE";
+        case OpCode::POP:               return "POP";
+        case OpCode::DEFINE_GLOBAL:     return "DEFINE_GLOBAL";
+        case OpCode::GET_GLOBAL:        return "GET_GLOBAL";
+        case OpCode::SET_GLOBAL:        return "SET_GLOBAL";
+        case OpCode::EQUAL:             return "EQUAL";
+        case OpCode::NOT_EQUAL:         return "NOT_EQUAL";
+        case OpCode::GREATER:           return "GREATER";
+        case OpCode::GREATER_EQUAL:     return "GREATER_EQUAL";
+        case OpCode::LESS:              return "LESS";
+        case OpCode::LESS_EQUAL:        return "LESS_EQUAL";
+        case OpCode::ADD:               return "ADD";
+        case OpCode::SUBTRACT:          return "SUBTRACT";
+        case OpCode::MULTIPLY:          return "MULTIPLY";
+        case OpCode::DIVIDE:            return "DIVIDE";
+        case OpCode::NEGATE:            return "NEGATE";
+        case OpCode::NOT:               return "NOT";
+        case OpCode::PRINT:             return "PRINT";
+        case OpCode::RETURN:            return "RETURN";
+        case OpCode::CONSTANT_LONG:      return "CONSTANT_LONG";
+        case OpCode::DEFINE_GLOBAL_LONG: return "DEFINE_GLOBAL_LONG";
+        case OpCode::GET_GLOBAL_LONG:    return "GET_GLOBAL_LONG";
+        case OpCode::SET_GLOBAL_LONG:    return "SET_GLOBAL_LONG";
+        case OpCode::ADD_NUM:           return "ADD_NUM";
+        case OpCode::ADD_STR:           return "ADD_STR";
+        case OpCode::SUBTRACT_NUM:      return "SUBTRACT_NUM";
+        case OpCode::MULTIPLY_NUM:      return "MULTIPLY_NUM";
+        case OpCode::DIVIDE_NUM:        return "DIVIDE_NUM";
+        case OpCode::GREATER_NUM:       return "GREATER_NUM";
+        case OpCode::GREATER_EQUAL_NUM: return "GREATER_EQUAL_NUM";
+        case OpCode::LESS_NUM:          return "LESS_NUM";
+        case OpCode::LESS_EQUAL_NUM:    return "LESS_EQUAL_NUM";
+        case OpCode::ADD_INT:           return "ADD_INT";
+        case OpCode::SUBTRACT_INT:      return "SUBTRACT_INT";
+        case OpCode::MULTIPLY_INT:      return "MULTIPLY_INT";
+        case OpCode::GREATER_INT:       return "GREATER_INT";
+        case OpCode::GREATER_EQUAL_INT: return "GREATER_EQUAL_INT";
+        case OpCode::LESS_INT:          return "LESS_INT";
+        case OpCode::LESS_EQUAL_INT:    return "LESS_EQUAL_INT";
+        case OpCode::ADD_GLOBAL_CONST:      return "ADD_GLOBAL_CONST";
+        case OpCode::SUBTRACT_GLOBAL_CONST: return "SUBTRACT_GLOBAL_CONST";
+        case OpCode::LESS_GLOBAL_CONST:     return "LESS_GLOBAL_CONST";
+        case OpCode::DEFINE_GLOBAL_CONST:   return "DEFINE_GLOBAL_CONST";
+        case OpCode::SET_GLOBAL_POP:        return "SET_GLOBAL_POP";
+        default:                        return nullptr;
+    }
+}
+
 void printToken(Token token) {
     printf("%s '%.*s'", tokenTypeToStr(token.type), token.length, token.start); 
 }
@@ -120,6 +205,7 @@ char const * tokenTypeToStr(Token::Type t) {
         case Token::IDENTIFIER:     return "IDENTIFIER";
         case Token::STRING:         return "STRING";
         case Token::NUMBER:         return "NUMBER";
+        case Token::INTEGER:        return "INTEGER";
         case Token::AND:            return "AND";
         case Token::ELSE:           return "ELSE";
         case Token::FALSE:          return "FALSE";
@@ -144,7 +230,7 @@ void debugObjectLinkedList(Obj * obj) {
     printf("Objects:\n");
     while( obj != nullptr ){
         printf("  %p: [", obj);
-        obj->print();
+        printObject(obj);
         printf("]\n");
         obj = obj->next;
     }
@@ -8,9 +8,12 @@
 #include <stddef.h>
 
 
+class Vm;
+
 class Dissassembler {
 public:
     Dissassembler();
+    Dissassembler(Vm * vm);  // vm is used to look up global variable names
     ~Dissassembler();
 
     void disassembleChunk(Chunk * chunk, char const * name);
@@ -19,11 +22,19 @@ public:
 private:
     int disassembleInstruction_(Chunk * chunk, int offset, int line);
     int constantInstruction_(char const * name, Chunk * chunk, int offset);
+    int globalInstruction_(char const * name, Chunk * chunk, int offset);
+    int globalConstantInstruction_(char const * name, Chunk * chunk, int offset);
     int simpleInstruction_(char const * name);
+    int operand_(Chunk * chunk, int offset);
+
+    Vm * vm_;
 };
 
 void debugScanner(char const * source);
 
+// Name of an opcode, or nullptr if it isn't one
+char const * opCodeToStr(uint8_t op);
+
 void printToken(Token token);
 char const * tokenTypeToStr(Token::Type t);
 
@@ -0,0 +1,15 @@
+#include "integer.hpp"
+#include "vm.hpp"
+
+#include <new>
+
+ObjInteger * ObjInteger::newInteger(Vm * vm, int64_t value) {
+    void * mem = vm->allocateObjNoCollect(sizeof(ObjInteger));
+    ObjInteger * integer = new (mem) ObjInteger(value);
+    vm->registerObj(integer);
+    return integer;
+}
+
+ObjInteger::ObjInteger(int64_t value): Obj(Obj::Type::INTEGER) {
+    value_ = value;
+}
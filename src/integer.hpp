@@ -0,0 +1,31 @@
+#pragma once
+
+#include "object.hpp"
+
+#include <stdint.h>
+
+// predeclare Vm
+class Vm;
+
+/**
+ * Garbage-collected integer: one too big for a Value's inline integer (NaN-boxed values
+ * only have room for 48 bits), boxed so that integers keep all 64 bits.
+ * Only ever made for integers outside the inline range, so each integer has just one
+ * representation.
+ */
+class ObjInteger : public Obj {
+public:
+    /**
+     * Constructor helper. Never collects garbage (see Vm::allocateObjNoCollect), so it's
+     * safe in the middle of arithmetic: the caller must make the result reachable before
+     * anything else is allocated.
+     */
+    static ObjInteger * newInteger(Vm * vm, int64_t value);
+
+    int64_t get() const { return value_; }
+private:
+    // Private constructor: must construct with helper!
+    ObjInteger(int64_t value);
+
+    int64_t value_;
+};
@@ -0,0 +1,512 @@
+#include "jit.hpp"
+#include "chunk.hpp"
+#include "vm.hpp"
+
+#include <string.h>
+#include <vector>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__linux__) && defined(NAN_BOXING)
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+JitCode::JitCode(void * memory, size_t size): memory_(memory), size_(size) {
+}
+
+JitCode::~JitCode() {
+#ifdef JIT_X86_64
+    munmap(memory_, size_);
+#endif
+}
+
+bool Jit::isSupported() {
+#ifdef JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+Value * Jit::helper_(Vm * vm, Value * stackTop, int op, int operand, int offset) {
+    // Bring the Vm up to date, so collections see the whole stack and errors get the right line:
+    vm->stackTop_ = stackTop;
+    vm->ip_ = vm->chunk_->getCode() + offset + 1;
+    Value result;
+
+    switch( op ){
+        case OpCode::GET_GLOBAL:
+        case OpCode::SET_GLOBAL:
+            // only called when the global is undefined
+            vm->runtimeError_("Undefined variable '%s'.", vm->globalNames_[operand]->get());
+            return nullptr;
+        case OpCode::EQUAL:
+            vm->push(Value::boolean( vm->pop().equals(vm->pop()) ));
+            break;
+        case OpCode::NOT_EQUAL:
+            vm->push(Value::boolean( !vm->pop().equals(vm->pop()) ));
+            break;
+        case OpCode::ADD:
+            if( vm->peek(1).isString() ){
+                // implicitly convert second operand to string
+                vm->concatenate_();
+            }else if( vm->numericBinary(OpCode::ADD, vm->peek(1), vm->peek(0), result) ){
+                vm->stackTop_ -= 2;
+                vm->push(result);
+            }else{
+                vm->runtimeError_("Invalid operands for +");
+                return nullptr;
+            }
+            break;
+        case OpCode::SUBTRACT:
+        case OpCode::MULTIPLY:
+        case OpCode::DIVIDE:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+            // the compiled code handles numbers inline: this is for integer overflow, boxed
+            // integers and errors
+            if( !vm->numericBinary((uint8_t)op, vm->peek(1), vm->peek(0), result) ){
+                vm->runtimeError_("Operands must be numbers.");
+                return nullptr;
+            }
+            vm->stackTop_ -= 2;
+            vm->push(result);
+            break;
+        case OpCode::NEGATE:
+            if( vm->peek(0).isAnyInteger() ){
+                vm->push( negateInteger(vm, vm->pop().toInteger()) );
+            }else if( vm->peek(0).isNumber() ){
+                vm->push( Value::number(-vm->pop().asNumber()) );
+            }else{
+                vm->runtimeError_("Operand must be a number");
+                return nullptr;
+            }
+            break;
+        case OpCode::NOT:
+            vm->push(Value::boolean(!vm->pop().isTruthy()));
+            break;
+        case OpCode::PRINT:
+            vm->pop().write(vm->output_);
+            vm->output_.writeChar('\n');
+            break;
+    }
+    return vm->stackTop_;
+}
+
+#ifdef JIT_X86_64
+
+/**
+ * Machine code being assembled, with forward jumps patched once their target is known
+ */
+struct CodeBuffer {
+    std::vector<uint8_t> bytes;
+
+    void emit(std::initializer_list<uint8_t> code) {
+        bytes.insert(bytes.end(), code);
+    }
+
+    void emit32(uint32_t value) {
+        for( int i = 0; i < 4; ++i ) bytes.push_back((uint8_t)(value >> (8 * i)));
+    }
+
+    void emit64(uint64_t value) {
+        for( int i = 0; i < 8; ++i ) bytes.push_back((uint8_t)(value >> (8 * i)));
+    }
+
+    // Emit a jump with a 32-bit displacement to fill in later: returns where the displacement is
+    size_t jump(std::initializer_list<uint8_t> opcode) {
+        emit(opcode);
+        size_t at = bytes.size();
+        emit32(0);
+        return at;
+    }
+
+    // Point a jump at the current end of the code
+    void land(size_t at) {
+        landAt(at, bytes.size());
+    }
+
+    // Point a jump at `target`
+    void landAt(size_t at, size_t target) {
+        int32_t displacement = (int32_t)((int64_t)target - (int64_t)(at + 4));
+        memcpy(&bytes[at], &displacement, sizeof(displacement));
+    }
+};
+
+/**
+ * An integer operand of a double instruction, converted out of line
+ */
+struct Conversion {
+    size_t jump;                // jump from the fast path
+    bool second;                // b (rdx, xmm1) rather than a (rax, xmm0)
+    size_t resume;              // where the fast path continues with the double
+};
+
+/**
+ * Out of line code for an instruction's uncommon cases (integer conversions and a helper
+ * call), placed after the chunk's code so the fast paths stay dense
+ */
+struct SlowPath {
+    std::vector<size_t> jumps;  // jumps from the fast path
+    int op;
+    int operand;
+    int offset;
+    size_t resume;              // where the fast path continues
+    std::vector<Conversion> conversions;
+};
+
+/**
+ * Register use in compiled code (all callee-saved, so they survive helper calls):
+ *   rbx  Vm *
+ *   r12  stack top (Value *), handed to and returned from the helper
+ *   r13  global values (Value *)
+ *   r14  Value::QNAN, to test for numbers
+ *   r15  Value::UNDEFINED_VAL, to test for undefined globals
+ *   rbp  Value::QNAN | Value::INTEGER_TAG, to box integers
+ * rax, rcx, rdx, rsi, xmm0 and xmm1 are scratch.
+ */
+static std::initializer_list<uint8_t> const JE_  = {0x0f, 0x84};
+static std::initializer_list<uint8_t> const JNE_ = {0x0f, 0x85};
+static std::initializer_list<uint8_t> const JO_  = {0x0f, 0x80};
+static std::initializer_list<uint8_t> const JMP_ = {0xe9};
+
+// mov rax, imm64
+static void loadRax_(CodeBuffer & code, uint64_t value) {
+    code.emit({0x48, 0xb8});
+    code.emit64(value);
+}
+
+// mov [r12], rax; add r12, 8
+static void pushRax_(CodeBuffer & code) {
+    code.emit({0x49, 0x89, 0x04, 0x24, 0x49, 0x83, 0xc4, 0x08});
+}
+
+// Out of line: convert the integer in rax (or rdx, for the second operand) to a double in
+// xmm0 (or xmm1), jumping to `slow` if it isn't one
+static void convertInteger_(CodeBuffer & code, bool second, std::vector<size_t> & slow) {
+    code.emit({0x48, 0x89, (uint8_t)(second ? 0xd6 : 0xc6)});  // mov rsi, rax/rdx
+    code.emit({0x48, 0x31, 0xee});                              // xor rsi, rbp
+    code.emit({0x48, 0xc1, 0xee, 0x30});                        // shr rsi, 48
+    slow.push_back(code.jump(JNE_));
+    if( second ){
+        code.emit({0x48, 0xc1, 0xe2, 0x10, 0x48, 0xc1, 0xfa, 0x10});  // shl rdx, 16; sar rdx, 16
+        code.emit({0xf2, 0x48, 0x0f, 0x2a, 0xca});                    // cvtsi2sd xmm1, rdx
+    }else{
+        code.emit({0x48, 0xc1, 0xe0, 0x10, 0x48, 0xc1, 0xf8, 0x10});  // shl rax, 16; sar rax, 16
+        code.emit({0xf2, 0x48, 0x0f, 0x2a, 0xc0});                    // cvtsi2sd xmm0, rax
+    }
+}
+
+// Load the top two values as doubles, a (xmm0) and b (xmm1). Operands which aren't doubles
+// are left to `conversions`, which carry on here with the double (or go to the slow path)
+static void loadNumbers_(CodeBuffer & code, std::vector<Conversion> & conversions) {
+    code.emit({0x49, 0x8b, 0x44, 0x24, 0xf0});  // mov rax, [r12-16]
+    code.emit({0x49, 0x8b, 0x54, 0x24, 0xf8});  // mov rdx, [r12-8]
+    code.emit({0x48, 0x89, 0xc6});  // mov rsi, rax
+    code.emit({0x4c, 0x21, 0xf6});  // and rsi, r14
+    code.emit({0x4c, 0x39, 0xf6});  // cmp rsi, r14
+    size_t a = code.jump(JE_);
+    code.emit({0x66, 0x48, 0x0f, 0x6e, 0xc0});  // movq xmm0, rax
+    conversions.push_back({a, false, code.bytes.size()});
+    code.emit({0x48, 0x89, 0xd6});  // mov rsi, rdx
+    code.emit({0x4c, 0x21, 0xf6});  // and rsi, r14
+    code.emit({0x4c, 0x39, 0xf6});  // cmp rsi, r14
+    size_t b = code.jump(JE_);
+    code.emit({0x66, 0x48, 0x0f, 0x6e, 0xca});  // movq xmm1, rdx
+    conversions.push_back({b, true, code.bytes.size()});
+}
+
+// Load the top two values, a (rax) and b (rdx), as integers shifted into the top 48 bits.
+// Shifted, 64-bit arithmetic overflows (setting OF) exactly when the 48-bit integers would,
+// and comparisons keep their order. Returns the jump taken unless both are integers
+static size_t loadIntegers_(CodeBuffer & code) {
+    code.emit({0x49, 0x8b, 0x44, 0x24, 0xf0});  // mov rax, [r12-16]
+    code.emit({0x49, 0x8b, 0x54, 0x24, 0xf8});  // mov rdx, [r12-8]
+    // both integers when neither has any top 16 bits which differ from rbp's:
+    code.emit({0x48, 0x89, 0xc6});              // mov rsi, rax
+    code.emit({0x48, 0x31, 0xee});              // xor rsi, rbp
+    code.emit({0x48, 0x89, 0xd1});              // mov rcx, rdx
+    code.emit({0x48, 0x31, 0xe9});              // xor rcx, rbp
+    code.emit({0x48, 0x09, 0xce});              // or rsi, rcx
+    code.emit({0x48, 0xc1, 0xee, 0x30});        // shr rsi, 48
+    size_t notIntegers = code.jump(JNE_);
+    code.emit({0x48, 0xc1, 0xe0, 0x10});        // shl rax, 16
+    code.emit({0x48, 0xc1, 0xe2, 0x10});        // shl rdx, 16
+    return notIntegers;
+}
+
+// Box the shifted integer result in rax, jumping to `slow` if it overflowed (the helper
+// promotes it to a double)
+static void boxInteger_(CodeBuffer & code, std::vector<size_t> & slow) {
+    slow.push_back(code.jump(JO_));
+    code.emit({0x48, 0xc1, 0xe8, 0x10});        // shr rax, 16
+    code.emit({0x48, 0x09, 0xe8});              // or rax, rbp
+}
+
+// Turn the condition in al into a boolean Value in rax
+static void boxBoolean_(CodeBuffer & code) {
+    // FALSE_VAL + 1 == TRUE_VAL
+    code.emit({0x0f, 0xb6, 0xc0});  // movzx eax, al
+    code.emit({0x48, 0x8d, 0x04, 0x05}); code.emit32((uint32_t)Value::TAG_FALSE);  // lea rax, [rax + TAG_FALSE]
+    code.emit({0x4c, 0x09, 0xf0});  // or rax, r14
+}
+
+// Replace the top two values with rax
+static void replaceTwoWithRax_(CodeBuffer & code) {
+    code.emit({0x49, 0x89, 0x44, 0x24, 0xf0});  // mov [r12-16], rax
+    code.emit({0x49, 0x83, 0xec, 0x08});        // sub r12, 8
+}
+
+// Operand of the global instructions as a displacement from r13
+static uint32_t globalDisplacement_(int slot) {
+    return (uint32_t)slot * (uint32_t)sizeof(Value);
+}
+
+// The generic form of a quickened instruction
+static uint8_t generic_(uint8_t op) {
+    switch( op ){
+        case OpCode::ADD_NUM:
+        case OpCode::ADD_INT:
+        case OpCode::ADD_STR:           return OpCode::ADD;
+        case OpCode::SUBTRACT_NUM:
+        case OpCode::SUBTRACT_INT:      return OpCode::SUBTRACT;
+        case OpCode::MULTIPLY_NUM:
+        case OpCode::MULTIPLY_INT:      return OpCode::MULTIPLY;
+        case OpCode::DIVIDE_NUM:        return OpCode::DIVIDE;
+        case OpCode::GREATER_NUM:
+        case OpCode::GREATER_INT:       return OpCode::GREATER;
+        case OpCode::GREATER_EQUAL_NUM:
+        case OpCode::GREATER_EQUAL_INT: return OpCode::GREATER_EQUAL;
+        case OpCode::LESS_NUM:
+        case OpCode::LESS_INT:          return OpCode::LESS;
+        case OpCode::LESS_EQUAL_NUM:
+        case OpCode::LESS_EQUAL_INT:    return OpCode::LESS_EQUAL;
+        default:                        return op;
+    }
+}
+
+/**
+ * An instruction to compile: superinstructions are compiled as the instructions they were
+ * fused from, sharing the superinstruction's offset
+ */
+struct Part {
+    uint8_t op;
+    int operand;
+};
+
+// Split the instruction at `bytecode` into its parts, returning how many
+static int split_(uint8_t const * bytecode, Part * parts) {
+    switch( bytecode[0] ){
+        case OpCode::ADD_GLOBAL_CONST:
+        case OpCode::SUBTRACT_GLOBAL_CONST:
+        case OpCode::LESS_GLOBAL_CONST:
+            parts[0] = Part{OpCode::GET_GLOBAL, bytecode[1]};
+            parts[1] = Part{OpCode::CONSTANT, bytecode[2]};
+            parts[2].op = bytecode[0] == OpCode::ADD_GLOBAL_CONST ? OpCode::ADD :
+                          bytecode[0] == OpCode::SUBTRACT_GLOBAL_CONST ? OpCode::SUBTRACT : OpCode::LESS;
+            parts[2].operand = 0;
+            return 3;
+        case OpCode::DEFINE_GLOBAL_CONST:
+            parts[0] = Part{OpCode::CONSTANT, bytecode[2]};
+            parts[1] = Part{OpCode::DEFINE_GLOBAL, bytecode[1]};
+            return 2;
+        case OpCode::SET_GLOBAL_POP:
+            parts[0] = Part{OpCode::SET_GLOBAL, bytecode[1]};
+            parts[1] = Part{OpCode::POP, 0};
+            return 2;
+    }
+    parts[0].op = generic_(bytecode[0]);
+    int length = OpCode::instructionLength(bytecode[0]);
+    parts[0].operand = length == 2 ? bytecode[1] : length == 4 ? readLongOperand(bytecode + 1) : 0;
+    return 1;
+}
+
+JitCode * Jit::compile(Chunk & chunk) {
+    CodeBuffer code;
+    std::vector<SlowPath> slowPaths;
+    std::vector<size_t> exits;   // jumps to the normal exit
+
+    // Prologue: six pushes and the return address, plus 8 bytes keep the stack 16-byte aligned for calls
+    code.emit({0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});  // push rbp, rbx, r12, r13, r14, r15
+    code.emit({0x48, 0x83, 0xec, 0x08});  // sub rsp, 8
+    code.emit({0x48, 0x89, 0xfb});  // mov rbx, rdi
+    code.emit({0x49, 0x89, 0xf4});  // mov r12, rsi
+    code.emit({0x49, 0x89, 0xd5});  // mov r13, rdx
+    code.emit({0x49, 0xbe}); code.emit64(Value::QNAN);           // mov r14, QNAN
+    code.emit({0x49, 0xbf}); code.emit64(Value::UNDEFINED_VAL);  // mov r15, UNDEFINED
+    code.emit({0x48, 0xbd}); code.emit64(Value::QNAN | Value::INTEGER_TAG);  // mov rbp, QNAN | INTEGER_TAG
+
+    uint8_t const * bytecode = chunk.getCode();
+    for( int offset = 0; offset < chunk.count(); offset += OpCode::instructionLength(bytecode[offset]) ){
+        Part parts[3];
+        int numParts = split_(bytecode + offset, parts);
+        for( int p = 0; p < numParts; ++p ){
+            uint8_t op = parts[p].op;
+            int operand = parts[p].operand;
+            SlowPath slow{{}, op, operand, offset, 0, {}};
+            switch( op ){
+                case OpCode::CONSTANT:
+                case OpCode::CONSTANT_LONG:
+                    // constants are kept alive by the chunk, so their bits can be baked in
+                    loadRax_(code, chunk.getConstant(operand).bits);
+                    pushRax_(code);
+                    break;
+                case OpCode::NIL:   loadRax_(code, Value::NIL_VAL);   pushRax_(code); break;
+                case OpCode::TRUE:  loadRax_(code, Value::TRUE_VAL);  pushRax_(code); break;
+                case OpCode::FALSE: loadRax_(code, Value::FALSE_VAL); pushRax_(code); break;
+                case OpCode::POP:
+                    code.emit({0x49, 0x83, 0xec, 0x08});  // sub r12, 8
+                    break;
+                case OpCode::DEFINE_GLOBAL:
+                case OpCode::DEFINE_GLOBAL_LONG:
+                    code.emit({0x49, 0x83, 0xec, 0x08});  // sub r12, 8
+                    code.emit({0x49, 0x8b, 0x04, 0x24});  // mov rax, [r12]
+                    code.emit({0x49, 0x89, 0x85}); code.emit32(globalDisplacement_(operand));  // mov [r13+slot], rax
+                    break;
+                case OpCode::GET_GLOBAL:
+                case OpCode::GET_GLOBAL_LONG:
+                case OpCode::SET_GLOBAL:
+                case OpCode::SET_GLOBAL_LONG: {
+                    bool get = op == OpCode::GET_GLOBAL || op == OpCode::GET_GLOBAL_LONG;
+                    slow.op = get ? OpCode::GET_GLOBAL : OpCode::SET_GLOBAL;
+                    code.emit({0x49, 0x8b, 0x85}); code.emit32(globalDisplacement_(operand));  // mov rax, [r13+slot]
+                    code.emit({0x4c, 0x39, 0xf8});  // cmp rax, r15
+                    slow.jumps.push_back(code.jump(JE_));
+                    if( get ){
+                        pushRax_(code);
+                    }else{
+                        // don't pop: the assignment can be used in an expression
+                        code.emit({0x49, 0x8b, 0x44, 0x24, 0xf8});  // mov rax, [r12-8]
+                        code.emit({0x49, 0x89, 0x85}); code.emit32(globalDisplacement_(operand));  // mov [r13+slot], rax
+                    }
+                    break;
+                }
+                case OpCode::ADD:
+                case OpCode::SUBTRACT:
+                case OpCode::MULTIPLY:
+                case OpCode::DIVIDE:
+                case OpCode::GREATER:
+                case OpCode::GREATER_EQUAL:
+                case OpCode::LESS:
+                case OpCode::LESS_EQUAL: {
+                    // Two integers: all but division (always a double) are done inline
+                    size_t done = 0;
+                    if( op != OpCode::DIVIDE ){
+                        size_t notIntegers = loadIntegers_(code);
+                        switch( op ){
+                            case OpCode::ADD:       code.emit({0x48, 0x01, 0xd0}); break;        // add rax, rdx
+                            case OpCode::SUBTRACT:  code.emit({0x48, 0x29, 0xd0}); break;        // sub rax, rdx
+                            // (only one factor stays shifted, for a shifted product)
+                            case OpCode::MULTIPLY:  code.emit({0x48, 0xc1, 0xfa, 0x10, 0x48, 0x0f, 0xaf, 0xc2}); break;  // sar rdx, 16; imul rax, rdx
+                            case OpCode::GREATER:       code.emit({0x48, 0x39, 0xd0, 0x0f, 0x9f, 0xc0}); break;  // cmp rax, rdx; setg al
+                            case OpCode::GREATER_EQUAL: code.emit({0x48, 0x39, 0xd0, 0x0f, 0x9d, 0xc0}); break;  // cmp rax, rdx; setge al
+                            case OpCode::LESS:          code.emit({0x48, 0x39, 0xd0, 0x0f, 0x9c, 0xc0}); break;  // cmp rax, rdx; setl al
+                            case OpCode::LESS_EQUAL:    code.emit({0x48, 0x39, 0xd0, 0x0f, 0x9e, 0xc0}); break;  // cmp rax, rdx; setle al
+                        }
+                        if( op == OpCode::ADD || op == OpCode::SUBTRACT || op == OpCode::MULTIPLY ){
+                            boxInteger_(code, slow.jumps);
+                        }else{
+                            boxBoolean_(code);
+                        }
+                        done = code.jump(JMP_);
+                        code.land(notIntegers);
+                    }
+                    // Doubles, or an integer mixed with a double (converted out of line):
+                    loadNumbers_(code, slow.conversions);
+                    switch( op ){
+                        case OpCode::ADD:       code.emit({0xf2, 0x0f, 0x58, 0xc1}); break;  // addsd xmm0, xmm1
+                        case OpCode::SUBTRACT:  code.emit({0xf2, 0x0f, 0x5c, 0xc1}); break;  // subsd xmm0, xmm1
+                        case OpCode::MULTIPLY:  code.emit({0xf2, 0x0f, 0x59, 0xc1}); break;  // mulsd xmm0, xmm1
+                        case OpCode::DIVIDE:    code.emit({0xf2, 0x0f, 0x5e, 0xc1}); break;  // divsd xmm0, xmm1
+                        // Comparisons: unordered (NaN) clears both `above` conditions, so is false
+                        case OpCode::GREATER:       code.emit({0x66, 0x0f, 0x2e, 0xc1, 0x0f, 0x97, 0xc0}); break;  // ucomisd xmm0, xmm1; seta al
+                        case OpCode::GREATER_EQUAL: code.emit({0x66, 0x0f, 0x2e, 0xc1, 0x0f, 0x93, 0xc0}); break;  // ucomisd xmm0, xmm1; setae al
+                        case OpCode::LESS:          code.emit({0x66, 0x0f, 0x2e, 0xc8, 0x0f, 0x97, 0xc0}); break;  // ucomisd xmm1, xmm0; seta al
+                        case OpCode::LESS_EQUAL:    code.emit({0x66, 0x0f, 0x2e, 0xc8, 0x0f, 0x93, 0xc0}); break;  // ucomisd xmm1, xmm0; setae al
+                    }
+                    if( op == OpCode::ADD || op == OpCode::SUBTRACT || op == OpCode::MULTIPLY || op == OpCode::DIVIDE ){
+                        code.emit({0x66, 0x48, 0x0f, 0x7e, 0xc0});  // movq rax, xmm0
+                    }else{
+                        boxBoolean_(code);
+                    }
+                    if( op != OpCode::DIVIDE ) code.land(done);
+                    replaceTwoWithRax_(code);
+                    break;
+                }
+                case OpCode::EQUAL:
+                case OpCode::NOT_EQUAL:
+                case OpCode::NEGATE:
+                case OpCode::NOT:
+                case OpCode::PRINT:
+                    // always out of line
+                    slow.jumps.push_back(code.jump(JMP_));
+                    break;
+                case OpCode::RETURN:
+                    exits.push_back(code.jump(JMP_));
+                    break;
+                default:
+                    return nullptr;  // not an instruction the JIT knows: interpret instead
+            }
+            if( !slow.jumps.empty() || !slow.conversions.empty() ){
+                slow.resume = code.bytes.size();
+                slowPaths.push_back(slow);
+            }
+        }
+    }
+
+    // Normal exit returns the stack top, the error exit returns nullptr:
+    for( size_t at : exits ) code.land(at);
+    code.emit({0x4c, 0x89, 0xe0});  // mov rax, r12
+    size_t epilogue = code.jump(JMP_);
+    size_t errorExit = code.bytes.size();
+    code.emit({0x31, 0xc0});        // xor eax, eax
+    code.land(epilogue);
+    code.emit({0x48, 0x83, 0xc4, 0x08});  // add rsp, 8
+    code.emit({0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0x5d});  // pop r15, r14, r13, r12, rbx, rbp
+    code.emit({0xc3});              // ret
+
+    // Slow paths: convert integer operands and carry on, or call the helper then carry on after
+    // the instruction (or leave on an error)
+    void * helper = (void *)&Jit::helper_;
+    for( SlowPath & slow : slowPaths ){
+        for( Conversion const & conversion : slow.conversions ){
+            code.land(conversion.jump);
+            convertInteger_(code, conversion.second, slow.jumps);
+            code.landAt(code.jump(JMP_), conversion.resume);
+        }
+        for( size_t at : slow.jumps ) code.land(at);
+        code.emit({0x48, 0x89, 0xdf});          // mov rdi, rbx
+        code.emit({0x4c, 0x89, 0xe6});          // mov rsi, r12
+        code.emit({0xba}); code.emit32((uint32_t)slow.op);           // mov edx, op
+        code.emit({0xb9}); code.emit32((uint32_t)slow.operand);      // mov ecx, operand
+        code.emit({0x41, 0xb8}); code.emit32((uint32_t)slow.offset); // mov r8d, offset
+        loadRax_(code, (uint64_t)(uintptr_t)helper);
+        code.emit({0xff, 0xd0});                // call rax
+        code.emit({0x48, 0x85, 0xc0});          // test rax, rax
+        code.landAt(code.jump(JE_), errorExit);
+        code.emit({0x49, 0x89, 0xc4});          // mov r12, rax
+        code.landAt(code.jump(JMP_), slow.resume);
+    }
+
+    // W^X: write the code while the mapping is read/write, then make it read/execute
+    size_t size = code.bytes.size();
+    void * memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if( memory == MAP_FAILED ) return nullptr;
+    memcpy(memory, code.bytes.data(), size);
+    if( mprotect(memory, size, PROT_READ | PROT_EXEC) != 0 ){
+        munmap(memory, size);
+        return nullptr;
+    }
+    return new JitCode(memory, size);
+}
+
+#else
+
+JitCode * Jit::compile(Chunk & chunk) {
+    (void) chunk;
+    return nullptr;
+}
+
+#endif
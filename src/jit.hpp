@@ -0,0 +1,67 @@
+#pragma once
+
+#include "value.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Vm;
+class Chunk;
+
+/**
+ * Native code compiled from a chunk, in its own executable mapping
+ * Owned by the chunk, and unmapped with it.
+ */
+class JitCode {
+public:
+    /**
+     * Signature of the compiled code: runs the chunk on the Vm's stack and globals
+     * @return the new stack top, or nullptr after a runtime error (already reported)
+     */
+    typedef Value * (*Entry)(Vm * vm, Value * stackTop, Value * globals);
+
+    JitCode(void * memory, size_t size);
+    ~JitCode();
+
+    // Owns the mapping, which is unmapped once: never copied
+    JitCode(JitCode const &) = delete;
+    JitCode & operator=(JitCode const &) = delete;
+
+    Entry getEntry() const { return (Entry)memory_; }
+    size_t size() const { return size_; }
+
+private:
+    void * memory_;
+    size_t size_;
+};
+
+/**
+ * Baseline JIT compiler: translates a chunk's bytecode to x86-64 machine code
+ *
+ * Each instruction becomes a fixed template (superinstructions become the templates of
+ * the instructions they were fused from), with the Vm, stack top and globals held in
+ * registers. Literals, stack and global operations, and arithmetic and comparisons on
+ * numbers run inline. Everything else, including the slow paths of the inline
+ * instructions (strings, type errors, undefined globals), calls back into the Vm through
+ * a single helper, which reports errors and line numbers exactly as the interpreter does.
+ *
+ * The code is written to a read/write mapping which is then made read/execute, so it is
+ * never writable and executable at once.
+ *
+ * Only available on x86-64 Linux with NaN-boxed values: elsewhere compile() always fails
+ * and chunks are interpreted.
+ */
+class Jit {
+public:
+    static bool isSupported();
+
+    /**
+     * Compile a chunk (which may have been quickened already)
+     * @return the code, or nullptr if unsupported or the code couldn't be mapped
+     */
+    static JitCode * compile(Chunk & chunk);
+
+private:
+    // Runs instruction `op` at `offset` in the Vm's current chunk, called from compiled code
+    static Value * helper_(Vm * vm, Value * stackTop, int op, int operand, int offset);
+};
@@ -2,6 +2,8 @@
 #include "vm.hpp"
 #include "chunk.hpp"
 #include "debug.hpp"
+#include "cache.hpp"
+#include "jit.hpp"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,9 +13,7 @@
 #include <readline/history.h>
 
 
-static void repl() {
-    Vm vm;
-
+static void repl(Vm & vm) {
     // TODO tab completion!
     // rl_completion_matches = autocomplete;  // ref https://eli.thegreenplace.net/2016/basics-of-using-the-readline-library/
 
@@ -31,44 +31,79 @@ static void repl() {
     }
 }
 
-static char* readFile(const char* path) {
-    // todo read in file as scanned instead of loading the whole thing into memory!
+static void runFile(Vm & vm, const char* path, bool useCache) {
+    // Run the cached bytecode if the script hasn't changed since it was compiled:
+    ChunkCache cache(&vm);
+    Chunk cached;
+    if( useCache && cache.load(path, cached) ){
+        vm.run(cached);
+        return;
+    }
+
     FILE* file = fopen(path, "rb");
     if( file == NULL ){
         fprintf(stderr, "Could not open file \"%s\".\n", path);
         exit(74);
     }
 
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
-
-    char* buffer = (char*)malloc(fileSize + 1);
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-    buffer[bytesRead] = '\0';
-
+    // Stream the file through the compiler, hashing it for the cache on the way:
+    FileSource fileSource(file);
+    HashingSource source(&fileSource);
+    Chunk chunk;
+    bool compiled = vm.compile(&source, chunk);
     fclose(file);
-    return buffer;
-}
 
-static void runFile(const char* path) {
-    Vm vm;
-    char* source = readFile(path);
-    InterpretResult result = vm.interpret(source);
-    free(source);
+    InterpretResult result = InterpretResult::COMPILE_ERR;
+    if( compiled ){
+        if( useCache ) cache.save(path, source.getHash(), chunk);  // best effort
+        result = vm.run(chunk);
+    }
 
     // if (result == INTERPRET_COMPILE_ERROR) exit(65);
     // if (result == INTERPRET_RUNTIME_ERROR) exit(70);
 }
 
+static int usage() {
+    fprintf(stderr, "Usage: pond [-O] [-F] [-C] [-J | -I] [path]\n");
+    fprintf(stderr, "  -O    run the peephole optimizer on compiled bytecode\n");
+    fprintf(stderr, "  -F    don't fold constant expressions at compile time\n");
+    fprintf(stderr, "  -C    don't read or write the bytecode cache (<path>c)\n");
+    fprintf(stderr, "  -J    compile every chunk to native code before running it\n");
+    fprintf(stderr, "  -I    only interpret. By default chunks are compiled on their %dth run, but the\n", Vm::JIT_HOT_RUNS);
+    fprintf(stderr, "        command line runs each script or REPL line once, so this is the default too\n");
+    return 64;
+}
+
 int main(int argc, char const * argv[]) {
-    if( argc == 1 ){
-        repl();
-    }else if( argc == 2 ){
-        runFile(argv[1]);
+    Vm vm;
+    char const * path = nullptr;
+    bool useCache = true;
+
+    for( int i = 1; i < argc; ++i ){
+        if( strcmp(argv[i], "-O") == 0 ){
+            vm.setOptimize(true);
+        }else if( strcmp(argv[i], "-F") == 0 ){
+            vm.setFoldConstants(false);
+        }else if( strcmp(argv[i], "-C") == 0 ){
+            useCache = false;
+        }else if( strcmp(argv[i], "-J") == 0 ){
+            if( !Jit::isSupported() ){
+                fprintf(stderr, "JIT not supported on this platform/build: interpreting\n");
+            }
+            vm.setJitMode(JitMode::ALWAYS);
+        }else if( strcmp(argv[i], "-I") == 0 ){
+            vm.setJitMode(JitMode::NEVER);
+        }else if( argv[i][0] != '-' && path == nullptr ){
+            path = argv[i];
+        }else{
+            return usage();
+        }
+    }
+
+    if( path == nullptr ){
+        repl(vm);
     }else{
-        fprintf(stderr, "Usage: pond [path]\n");
-        return 64;
+        runFile(vm, path, useCache);
     }
 
     return 0;
@@ -0,0 +1,53 @@
+
+#include "memory.hpp"
+
+#include <new>
+
+Arena::Arena() {
+    for( int i = 0; i < NUM_CLASSES; ++i ){
+        freeLists_[i] = nullptr;
+    }
+    bump_ = nullptr;
+    bumpEnd_ = nullptr;
+}
+
+Arena::~Arena() {
+    for( void * page : pages_ ){
+        ::operator delete(page);
+    }
+}
+
+void * Arena::allocate(size_t size) {
+    if( size > MAX_SMALL ) return ::operator new(size);
+
+    // reuse a freed block of the same class if there is one:
+    int cls = sizeClass_(size);
+    FreeBlock * block = freeLists_[cls];
+    if( block != nullptr ){
+        freeLists_[cls] = block->next;
+        return block;
+    }
+
+    // otherwise carve a new block from the current page:
+    size_t blockSize = (size_t)(cls + 1) * GRANULE;
+    if( bump_ == nullptr || (size_t)(bumpEnd_ - bump_) < blockSize ){
+        // NOTE: the tail of the old page is wasted, at most MAX_SMALL bytes
+        bump_ = (char*)::operator new(PAGE_SIZE);
+        bumpEnd_ = bump_ + PAGE_SIZE;
+        pages_.push_back(bump_);
+    }
+    void * ptr = bump_;
+    bump_ += blockSize;
+    return ptr;
+}
+
+void Arena::free(void * ptr, size_t size) {
+    if( size > MAX_SMALL ){
+        ::operator delete(ptr);
+        return;
+    }
+    int cls = sizeClass_(size);
+    FreeBlock * block = (FreeBlock*)ptr;
+    block->next = freeLists_[cls];
+    freeLists_[cls] = block;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Size-class allocator for small objects
+ *
+ * Small blocks are rounded up to a multiple of GRANULE and carved out of large pages,
+ * with freed blocks kept on a free list per size class. Larger blocks go straight to
+ * the system allocator. Blocks must be freed with the same size they were allocated with.
+ */
+class Arena {
+public:
+    Arena();
+    ~Arena();
+
+    void * allocate(size_t size);
+    void free(void * ptr, size_t size);
+
+    static size_t const GRANULE = 16;     // alignment and size class step
+    static size_t const MAX_SMALL = 256;  // largest block served from a size class
+
+private:
+    struct FreeBlock {
+        FreeBlock * next;
+    };
+
+    static int const NUM_CLASSES = (int)(MAX_SMALL / GRANULE);
+    static size_t const PAGE_SIZE = 64 * 1024;
+
+    static inline int sizeClass_(size_t size){ return (int)((size - 1) / GRANULE); }
+
+    FreeBlock * freeLists_[NUM_CLASSES];
+    std::vector<void*> pages_;
+    char * bump_;     // next unused byte in the current page
+    char * bumpEnd_;  // end of the current page
+};
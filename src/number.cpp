@@ -0,0 +1,84 @@
+#include "number.hpp"
+
+#include <charconv>
+#include <math.h>  // HUGE_VAL, signbit
+#include <stdint.h>
+
+// Powers of ten which are exact in a double
+static double const POWERS_OF_TEN_[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int const MAX_DIGITS_ = 19;                    // always fit in a uint64_t
+static uint64_t const MAX_EXACT_ = (uint64_t)1 << 53;  // largest exact integer in a double
+
+double parseNumber(char const * start, int length) {
+    char const * end = start + length;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int decimals = -1;  // digits after the '.', if there is one
+
+    for( char const * c = start; c < end; ++c ){
+        if( *c == '.' ){
+            decimals = 0;
+            continue;
+        }
+        // leading zeros don't count towards the limit:
+        if( mantissa != 0 || *c != '0' ) digits++;
+        mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+        if( decimals >= 0 ) decimals++;
+        if( digits > MAX_DIGITS_ ) break;
+    }
+    if( decimals < 0 ) decimals = 0;
+
+    if( digits <= MAX_DIGITS_ && mantissa <= MAX_EXACT_ && decimals <= 22 ){
+        return (double)mantissa / POWERS_OF_TEN_[decimals];
+    }
+
+    // Hard case:
+    double number = 0;
+    if( std::from_chars(start, end, number).ec == std::errc::result_out_of_range ){
+        // too big (any non-zero integer digit) or too small, round as strtod does:
+        for( char const * c = start; c < end && *c != '.'; ++c ){
+            if( *c != '0' ) return HUGE_VAL;
+        }
+        return 0;
+    }
+    return number;
+}
+
+bool parseInteger(char const * start, int length, int64_t & integer) {
+    std::from_chars_result result = std::from_chars(start, start + length, integer);
+    return result.ec == std::errc() && result.ptr == start + length;
+}
+
+int formatInteger(int64_t integer, char * buffer) {
+    char * p = buffer;
+    uint64_t magnitude = (uint64_t)integer;
+    if( integer < 0 ){
+        *p++ = '-';
+        magnitude = 0 - magnitude;
+    }
+    // write the digits backwards then reverse them:
+    char * digits = p;
+    do {
+        *p++ = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while( magnitude != 0 );
+    for( char * a = digits, * b = p - 1; a < b; ++a, --b ){
+        char c = *a; *a = *b; *b = c;
+    }
+    return (int)(p - buffer);
+}
+
+int formatNumber(double number, char * buffer) {
+    // Integer fast path (but leave -0 to to_chars):
+    double const limit = (double)MAX_EXACT_;
+    if( number >= -limit && number <= limit && number == (double)(int64_t)number &&
+        !(number == 0 && signbit(number)) ){
+        return formatInteger((int64_t)number, buffer);
+    }
+
+    return (int)(std::to_chars(buffer, buffer + NUMBER_BUFFER_SIZE, number).ptr - buffer);
+}
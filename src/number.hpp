@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Convert the text of a number literal (digits, optionally followed by '.' and more
+ * digits) to the nearest double
+ *
+ * Most literals take Clinger's fast path: with at most 19 significant digits, a
+ * mantissa that fits exactly in a double and at most 22 decimal places, one exact
+ * division by a power of ten gives the correctly rounded result. Anything harder goes
+ * to std::from_chars, which is exact and (unlike strtod) ignores the locale.
+ */
+double parseNumber(char const * start, int length);
+
+/**
+ * Convert the text of an integer literal (digits only) to an int64_t
+ * @return false if it is out of range (it is then a double literal instead)
+ */
+bool parseInteger(char const * start, int length, int64_t & integer);
+
+/**
+ * Write the shortest text which reads back as exactly `number` (no NUL terminator)
+ * and return its length.
+ *
+ * Whole numbers up to 2^53 are written as integers (e.g. "1000000"), by a fast path
+ * which doesn't need the general algorithm. Anything else is the shortest round-trip
+ * form from std::to_chars (Ryu), e.g. "0.1", "1e+100", "inf", "nan".
+ */
+int formatNumber(double number, char * buffer);
+
+// Write an integer in decimal (no NUL terminator) and return its length
+int formatInteger(int64_t integer, char * buffer);
+
+// Big enough for any formatted number
+static int const NUMBER_BUFFER_SIZE = 32;
@@ -1,12 +1,36 @@
-
 #include "object.hpp"
-#include "vm.hpp"
+#include "str.hpp"
+#include "integer.hpp"
+#include "number.hpp"
+
+#include <stdio.h>
 
+ObjString * objectToString(Vm * vm, Obj * obj) {
+    switch( obj->type ){
+        case Obj::Type::STRING: return (ObjString *)obj;
+        case Obj::Type::INTEGER: {
+            char buffer[NUMBER_BUFFER_SIZE];
+            return ObjString::newString(vm, buffer, formatInteger(((ObjInteger *)obj)->get(), buffer));
+        }
+    }
+    return nullptr;  // unreachable
+}
 
-Obj::Obj(Vm * vm, Type t): type(t), vm_(vm) {
-    vm_->registerObj(this);
+void printObject(Obj * obj) {
+    switch( obj->type ){
+        case Obj::Type::STRING:
+            printf("%s", ((ObjString *)obj)->get());
+            break;
+        case Obj::Type::INTEGER:
+            printf("%lld", (long long)((ObjInteger *)obj)->get());
+            break;
+    }
 }
 
-Obj::~Obj(){
-    vm_->deregisterObj(this);
+size_t objectSize(Obj * obj) {
+    switch( obj->type ){
+        case Obj::Type::STRING: return ObjString::allocationSize(((ObjString *)obj)->getLength());
+        case Obj::Type::INTEGER: return sizeof(ObjInteger);
+    }
+    return 0;  // unreachable
 }
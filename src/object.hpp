@@ -1,29 +1,40 @@
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
+
 // Predeclare references
 class Vm;
 class ObjString;
 
 /**
- * NOTE: if objects are all created via Vm, then we can do the register/deregister there, 
- * this may simplify ObjStrings
+ * Header common to all heap objects: 16 bytes, with no vtable
+ *
+ * Behaviour which depends on the kind of object is dispatched by switching on `type`
+ * (see the functions below), and objects are linked into the Vm's list by the Vm
+ * itself (Vm::registerObj), so they don't need to know which Vm owns them.
+ * Objects are trivially destructible: the Vm frees them according to their type.
  */
-
 struct Obj {
-    enum Type {
-        STRING
+    enum Type : uint8_t {
+        STRING,
+        INTEGER
     };
 
-    Obj(Vm * vm, Type t);
+    Obj(Type t): type(t), marked(false), next(nullptr) {}
 
-    virtual ~Obj();
+    Type type;
+    bool marked;  // reachable in the current garbage collection
+    Obj * next;   // linked list of all objects
+};
 
-    virtual ObjString * toString() = 0;
-    virtual void print() = 0;
+static_assert(sizeof(Obj) <= 16, "object header should fit in 16 bytes");
 
-    Type type;
-    Obj * next;  // linked list of all objects
+// String representation of an object
+ObjString * objectToString(Vm * vm, Obj * obj);
 
-private:
-    Vm * vm_;
-};
+// Print an object to stdout, for debugging
+void printObject(Obj * obj);
+
+// Number of bytes allocated for an object (header and payload)
+size_t objectSize(Obj * obj);
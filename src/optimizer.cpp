@@ -0,0 +1,182 @@
+
+#include "optimizer.hpp"
+
+Optimizer::Optimizer() {
+}
+
+Optimizer::~Optimizer() {
+}
+
+int Optimizer::optimize(Chunk & chunk) {
+    decode_(chunk);
+    int before = (int)code_.size();
+
+    rewrite_();
+    fuse_();
+
+    encode_(chunk);
+    return before - (int)code_.size();
+}
+
+void Optimizer::decode_(Chunk & chunk) {
+    code_.clear();
+    uint8_t const * code = chunk.getCode();
+    for( int offset = 0; offset < chunk.count(); ){
+        Instruction instr;
+        instr.op = code[offset];
+        instr.operand = 0;
+        instr.constant = 0;
+        instr.line = chunk.getLineNumber(offset);
+        int length = OpCode::instructionLength(instr.op);
+        if( length == 2 ) instr.operand = code[offset + 1];
+        if( length == 3 ){
+            instr.operand = code[offset + 1];
+            instr.constant = code[offset + 2];
+        }
+        if( length == 4 ) instr.operand = readLongOperand(code + offset + 1);
+        code_.push_back(instr);
+        offset += length;
+    }
+}
+
+void Optimizer::encode_(Chunk & chunk) {
+    // rewrite the bytecode and line table, the constants are untouched
+    // NOTE: the chunk's max stack depth is kept: the rewrites only ever make the stack shallower
+    chunk.code.clear();
+    chunk.lines.clear();
+    for( Instruction & instr : code_ ){
+        chunk.write(instr.op, instr.line);
+        int length = OpCode::instructionLength(instr.op);
+        if( length == 2 ){
+            chunk.write((uint8_t)instr.operand, instr.line);
+        }else if( length == 3 ){
+            chunk.write((uint8_t)instr.operand, instr.line);
+            chunk.write((uint8_t)instr.constant, instr.line);
+        }else if( length == 4 ){
+            chunk.write((uint8_t)(instr.operand & 0xff), instr.line);
+            chunk.write((uint8_t)((instr.operand >> 8) & 0xff), instr.line);
+            chunk.write((uint8_t)((instr.operand >> 16) & 0xff), instr.line);
+        }
+    }
+}
+
+bool Optimizer::is_(int index, uint8_t op) {
+    return index >= 0 && index < (int)code_.size() && code_[index].op == op;
+}
+
+bool Optimizer::isLiteral_(int index) {
+    return is_(index, OpCode::CONSTANT) || is_(index, OpCode::CONSTANT_LONG) || is_(index, OpCode::NIL) ||
+           is_(index, OpCode::TRUE) || is_(index, OpCode::FALSE);
+}
+
+bool Optimizer::producesBoolean_(int index) {
+    if( index < 0 ) return false;
+    switch( code_[index].op ){
+        case OpCode::TRUE:
+        case OpCode::FALSE:
+        case OpCode::NOT:
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Optimizer::rewrite_() {
+    // One pass, compacting in place: code_[0, kept) is the rewritten code so far. Each
+    // instruction is appended to it, then the patterns are matched against its end, so a
+    // rewrite which exposes another (e.g. dropping the `2;` in `x = 1; 2; print x;`) is
+    // caught when the instruction completing it arrives, without scanning again
+    int kept = 0;
+    for( int i = 0; i < (int)code_.size(); ++i ){
+        code_[kept++] = code_[i];
+        int last = kept - 1;
+
+        // Unused literal, e.g. the expression statement `1;`
+        // CONSTANT k, POP => (nothing)
+        if( is_(last, OpCode::POP) && isLiteral_(last-1) ){
+            kept -= 2;
+            continue;
+        }
+
+        // Double negation is a no-op on a boolean (so also !!!x == !x for any x)
+        // NOT, NOT => (nothing)
+        if( is_(last, OpCode::NOT) && is_(last-1, OpCode::NOT) && producesBoolean_(last-2) ){
+            kept -= 2;
+            continue;
+        }
+
+        // EQUAL, NOT => NOT_EQUAL (and vice versa)
+        if( is_(last, OpCode::NOT) && (is_(last-1, OpCode::EQUAL) || is_(last-1, OpCode::NOT_EQUAL)) ){
+            code_[last-1].op = is_(last-1, OpCode::EQUAL) ? OpCode::NOT_EQUAL : OpCode::EQUAL;
+            kept -= 1;
+            continue;
+        }
+
+        // Reading back a global which was just assigned: the value is still on the stack
+        // SET_GLOBAL x, POP, GET_GLOBAL x => SET_GLOBAL x
+        if( ((is_(last-2, OpCode::SET_GLOBAL) && is_(last, OpCode::GET_GLOBAL)) ||
+             (is_(last-2, OpCode::SET_GLOBAL_LONG) && is_(last, OpCode::GET_GLOBAL_LONG))) &&
+            is_(last-1, OpCode::POP) && code_[last-2].operand == code_[last].operand ){
+            kept -= 2;
+            continue;
+        }
+    }
+    code_.resize((size_t)kept);
+}
+
+bool Optimizer::sameLine_(int index, int count) {
+    for( int i = index + 1; i < index + count; ++i ){
+        if( code_[i].line != code_[index].line ) return false;
+    }
+    return true;
+}
+
+void Optimizer::fuse_() {
+    // Only sequences on a single line are fused, so errors still report the right line.
+    // Only the short forms are fused: both operands must fit in a byte.
+    std::vector<Instruction> fused;
+    for( int i = 0; i < (int)code_.size(); ++i ){
+        Instruction instr = code_[i];
+
+        // GET_GLOBAL x, CONSTANT k, ADD => ADD_GLOBAL_CONST x k (also SUBTRACT and LESS)
+        if( is_(i, OpCode::GET_GLOBAL) && is_(i+1, OpCode::CONSTANT) && sameLine_(i, 3) &&
+            (is_(i+2, OpCode::ADD) || is_(i+2, OpCode::SUBTRACT) || is_(i+2, OpCode::LESS)) ){
+            switch( code_[i+2].op ){
+                case OpCode::ADD:      instr.op = OpCode::ADD_GLOBAL_CONST; break;
+                case OpCode::SUBTRACT: instr.op = OpCode::SUBTRACT_GLOBAL_CONST; break;
+                default:               instr.op = OpCode::LESS_GLOBAL_CONST; break;
+            }
+            instr.constant = code_[i+1].operand;
+            fused.push_back(instr);
+            i += 2;
+            continue;
+        }
+
+        // CONSTANT k, DEFINE_GLOBAL x => DEFINE_GLOBAL_CONST x k
+        if( is_(i, OpCode::CONSTANT) && is_(i+1, OpCode::DEFINE_GLOBAL) && sameLine_(i, 2) ){
+            instr.op = OpCode::DEFINE_GLOBAL_CONST;
+            instr.operand = code_[i+1].operand;
+            instr.constant = code_[i].operand;
+            fused.push_back(instr);
+            i += 1;
+            continue;
+        }
+
+        // SET_GLOBAL x, POP => SET_GLOBAL_POP x (an assignment statement)
+        if( is_(i, OpCode::SET_GLOBAL) && is_(i+1, OpCode::POP) && sameLine_(i, 2) ){
+            instr.op = OpCode::SET_GLOBAL_POP;
+            fused.push_back(instr);
+            i += 1;
+            continue;
+        }
+
+        fused.push_back(instr);
+    }
+    code_.swap(fused);
+}
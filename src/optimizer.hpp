@@ -0,0 +1,44 @@
+#pragma once
+
+#include "chunk.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Peephole optimizer: rewrites wasteful instruction sequences in a compiled chunk, then
+ * fuses common sequences into superinstructions (one dispatch instead of two or three)
+ *
+ * NOTE: relies on chunks being straight-line code (no jumps), so any instruction
+ * can be removed or merged without patching offsets
+ */
+class Optimizer {
+public:
+    Optimizer();
+    ~Optimizer();
+
+    /**
+     * Optimize the chunk in place
+     * @return number of instructions removed
+     */
+    int optimize(Chunk & chunk);
+
+private:
+    struct Instruction {
+        uint8_t op;
+        int operand;  // only meaningful if the op has one
+        int constant; // second operand (constant index) of the global/constant superinstructions
+        int line;
+    };
+
+    void decode_(Chunk & chunk);
+    void encode_(Chunk & chunk);
+    void rewrite_();
+    void fuse_();
+    bool sameLine_(int index, int count);
+    bool producesBoolean_(int index);
+    bool isLiteral_(int index);
+    bool is_(int index, uint8_t op);
+
+    std::vector<Instruction> code_;
+};
@@ -0,0 +1,73 @@
+#include "output.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+
+Output::Output(): buffer_(BUFFER_SIZE), used_(0), sink_(nullptr) {
+    lineBuffered_ = isatty(STDOUT_FILENO);
+}
+
+Output::~Output() {
+    flush();
+}
+
+void Output::setSink(OutputSink * sink) {
+    flush();
+    sink_ = sink;
+    lineBuffered_ = sink == nullptr && isatty(STDOUT_FILENO);
+}
+
+void Output::flush() {
+    if( used_ == 0 ) return;
+    if( sink_ != nullptr ){
+        sink_->write(buffer_.data(), used_);
+    }else{
+        writeFd_(buffer_.data(), used_, nullptr, 0);
+    }
+    used_ = 0;
+}
+
+void Output::writeLarge_(char const * chars, size_t length) {
+    // Doesn't fit: send the buffer and the new chars together
+    if( sink_ != nullptr ){
+        flush();
+        sink_->write(chars, length);
+    }else{
+        writeFd_(buffer_.data(), used_, chars, length);
+        used_ = 0;
+    }
+}
+
+void Output::writeFd_(char const * a, size_t aLength, char const * b, size_t bLength) {
+    // anything already written through stdio (e.g. debug output) goes first:
+    fflush(stdout);
+
+    struct iovec parts[2] = {
+        {(void *)a, aLength},
+        {(void *)b, bLength}
+    };
+    struct iovec * part = parts;
+    int count = bLength > 0 ? 2 : 1;
+    while( count > 0 ){
+        ssize_t written = writev(STDOUT_FILENO, part, count);
+        if( written < 0 ){
+            if( errno == EINTR ) continue;
+            return;  // nowhere to report it: drop the output, as stdio would
+        }
+        // skip what was written, which may end part way through a part:
+        size_t done = (size_t)written;
+        while( count > 0 && done >= part->iov_len ){
+            done -= part->iov_len;
+            part++;
+            count--;
+        }
+        if( count > 0 ){
+            part->iov_base = (char *)part->iov_base + done;
+            part->iov_len -= done;
+        }
+    }
+}
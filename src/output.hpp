@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * Somewhere for script output to go, supplied by an embedder in place of stdout
+ */
+class OutputSink {
+public:
+    virtual ~OutputSink() {}
+
+    // Called with buffered output, in bulk
+    virtual void write(char const * chars, size_t length) = 0;
+};
+
+/**
+ * Buffered output for scripts (print), owned by the Vm
+ *
+ * Writes to stdout with write(2), bypassing stdio, or to an OutputSink. When stdout
+ * is a terminal the buffer is flushed at the end of each line (writeChar('\n')) so
+ * output appears as it is printed; otherwise it is only flushed when full (or
+ * explicitly), so piped or redirected output costs one system call per buffer.
+ */
+class Output {
+public:
+    Output();
+
+    // flushes anything left
+    ~Output();
+
+    // Send output to `sink` instead of stdout, or back to stdout if null (flushes first)
+    void setSink(OutputSink * sink);
+
+    inline void write(char const * chars, size_t length) {
+        if( length <= buffer_.size() - used_ ){
+            memcpy(&buffer_[used_], chars, length);
+            used_ += length;
+        }else{
+            writeLarge_(chars, length);
+        }
+    }
+
+    inline void writeChar(char c) {
+        if( used_ == buffer_.size() ) flush();
+        buffer_[used_++] = c;
+        if( c == '\n' && lineBuffered_ ) flush();
+    }
+
+    void flush();
+
+    static size_t const BUFFER_SIZE = 64 * 1024;
+
+private:
+    void writeLarge_(char const * chars, size_t length);
+    void writeFd_(char const * a, size_t aLength, char const * b, size_t bLength);
+
+    std::vector<char> buffer_;
+    size_t used_;
+    bool lineBuffered_;  // flush at each newline
+    OutputSink * sink_;  // null for stdout
+};
@@ -1,9 +1,11 @@
 
 #include "scanner.hpp"
+#include "number.hpp"
 
 #include "string.h"
 
-Scanner::Scanner() {
+Scanner::Scanner(): limit_(nullptr), kernels_(Simd::lexKernels()), source_(nullptr), activeBuffer_(0),
+    bufferSize_(0), switchedBuffers_(false) {
 }
 
 Scanner::~Scanner() {
@@ -13,32 +15,79 @@ void Scanner::init(char const * source) {
     start_ = source;
     current_ = source;
     line_ = 1;
+    limit_ = source + strlen(source);
+    kernels_ = Simd::lexKernels();
+    source_ = nullptr;
 }
 
-void Scanner::incrementLine_() {
-    // clamp at maximum value
-    if( line_ < MAX_LINES ){
-        line_++;
+void Scanner::init(Source * source, size_t bufferSize) {
+    source_ = source;
+    bufferSize_ = bufferSize;
+    activeBuffer_ = 0;
+    buffers_[0].assign(1, '\0');  // empty: the first peek refills
+    start_ = buffers_[0].data();
+    current_ = start_;
+    limit_ = start_;
+    line_ = 1;
+    kernels_ = Simd::lexKernels();
+}
+
+bool Scanner::refill_() {
+    // a NUL before the end of the data (or any NUL in a string) really is the end:
+    if( source_ == nullptr || current_ != limit_ ) return false;
+
+    // Carry the part of the token scanned so far over to the start of the other
+    // buffer, leaving the active one alone as the previous token may still be in use.
+    // Once this token has switched buffers (or if it starts the active one) the
+    // previous token must be in the other buffer, so refill the active one in place.
+    size_t carry = (size_t)(limit_ - start_);
+    bool inPlace = switchedBuffers_ || buffers_[activeBuffer_].data() == start_;
+    int next = inPlace ? activeBuffer_ : activeBuffer_ ^ 1;
+    std::vector<char> & buffer = buffers_[next];
+    if( inPlace ){
+        memmove(buffer.data(), start_, carry);  // before growing, which would move start_
+        if( buffer.size() < carry + bufferSize_ + 1 ) buffer.resize(carry + bufferSize_ + 1);
+    }else{
+        if( buffer.size() < carry + bufferSize_ + 1 ) buffer.resize(carry + bufferSize_ + 1);
+        memcpy(buffer.data(), start_, carry);
+        switchedBuffers_ = true;
     }
+
+    size_t count = source_->read(buffer.data() + carry, bufferSize_);
+    buffer[carry + count] = '\0';
+    activeBuffer_ = next;
+    start_ = buffer.data();
+    current_ = start_ + carry;
+    limit_ = current_ + count;
+    if( count == 0 ){
+        source_ = nullptr;  // end of the source
+        return false;
+    }
+    return true;
 }
 
 void Scanner::skipWhitespace_() {
     for(;;){
+        start_ = current_;  // nothing to carry over a refill yet
         switch( peek_() ){
             case '\n':
-                incrementLine_();
+                line_++;
                 // Fall-through
             case ' ':
             case '\r':
             case '\t':
                 advance_();
+                current_ = kernels_.skipWhitespace(current_, limit_, line_);  // rest of the run
                 break;
 
             case '#':
                 // comment out the rest of the line:
                 while( peek_()!='\n' && !isAtEnd_() ){
                     advance_();
+                    current_ = kernels_.skipComment(current_, limit_);
+                    start_ = current_;
                 }
+                break;  // the newline is skipped next time round
 
             default:
                 return;
@@ -60,8 +109,9 @@ Token Scanner::makeToken_(Token::Type type) {
   Token token;
   token.type = type;
   token.start = start_;
-  token.length = (uint16_t)(current_ - start_);
+  token.length = (int)(current_ - start_);
   token.line = line_;
+  token.number = 0;
   return token;
 }
 
@@ -69,8 +119,9 @@ Token Scanner::makeErrorToken_(const char* message) {
   Token token;
   token.type = Token::ERROR;
   token.start = message;
-  token.length = (uint16_t)strlen(message);
+  token.length = (int)strlen(message);
   token.line = line_;
+  token.number = 0;
   return token;
 }
 
@@ -79,6 +130,7 @@ Token Scanner::makeStringToken_() {
     while( peek_() != '"' && !isAtEnd_() ){
         if( peek_() == '\n' ) line_++;
         advance_();
+        current_ = kernels_.skipString(current_, limit_, line_);
     }
 
     if( isAtEnd_() ) return makeErrorToken_("Unterminated string");
@@ -140,10 +192,12 @@ Token::Type Scanner::checkKeyword_(int offset, int len, char const * rest, Token
 Token Scanner::makeNumberToken_() {
     while( isDigit_(peek_()) ){
         advance_();
+        current_ = kernels_.skipDigits(current_, limit_);
     }
 
     // Look for a fractional part.
-    if( peek_() == '.' ) {
+    bool fraction = peek_() == '.';
+    if( fraction ) {
         // Consume the ".".
         advance_();
 
@@ -154,13 +208,24 @@ Token Scanner::makeNumberToken_() {
 
         while( isDigit_(peek_()) ){
             advance_();
+            current_ = kernels_.skipDigits(current_, limit_);
         }
     }
 
-    return makeToken_(Token::NUMBER);
+    // Convert it while the characters are at hand. Digits alone are an integer, unless
+    // too big for one:
+    if( !fraction ){
+        Token token = makeToken_(Token::INTEGER);
+        if( parseInteger(token.start, token.length, token.integer) ) return token;
+    }
+    Token token = makeToken_(Token::NUMBER);
+    token.number = parseNumber(token.start, token.length);
+    return token;
 }
 
 Token Scanner::scanToken() {
+    switchedBuffers_ = false;
+
     // first, gobble up whitespace and comments:
     skipWhitespace_();
 
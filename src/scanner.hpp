@@ -1,10 +1,11 @@
 #pragma once
 
-#include <stdint.h>
+#include "source.hpp"
+#include "simd.hpp"
 
-/**
- * TODO streaming not load whole thing into a buffer
-*/
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
 
 struct Token {
     enum Type {
@@ -19,7 +20,7 @@ struct Token {
         GREATER, GREATER_EQUAL,
         LESS, LESS_EQUAL,
         // Literals:
-        IDENTIFIER, STRING, NUMBER,   // TODO int
+        IDENTIFIER, STRING, NUMBER, INTEGER,
         // Keywords:
         AND, ELSE, FALSE,
         FOR, FN, IF, NIL, OR,
@@ -31,25 +32,41 @@ struct Token {
 
     Type type;
     char const * start;
-    uint16_t length;
-    uint16_t line;
+    int length;
+    int line;
+    double number;    // value of a NUMBER token
+    int64_t integer;  // value of an INTEGER token
 };
 
+/**
+ * Splits source code into tokens
+ *
+ * Either scans a NUL terminated string in place, or streams from a Source through
+ * a pair of buffers. A token's characters stay valid until the token after next
+ * is scanned, so the compiler can look at its current and previous tokens (and
+ * must copy out anything it keeps longer, like string constants).
+ */
 class Scanner {
 public:
     Scanner();
     
     ~Scanner();
 
+    // Scan a NUL terminated string, which must outlive the scanner's tokens
+    // NOTE: picks up the current Simd level
     void init(char const * source);
+
+    // Stream from a source, reading `bufferSize` bytes at a time
+    void init(Source * source, size_t bufferSize = DEFAULT_BUFFER_SIZE);
     
     Token scanToken();
 
-    static uint16_t const MAX_LINES = 0xFFFF;
+    static size_t const DEFAULT_BUFFER_SIZE = 64 * 1024;
 
 private:
-    inline bool isAtEnd_(){ return *current_ == '\0'; }
-    inline char peek_(){ return *current_; }
+    inline bool isAtEnd_(){ return peek_() == '\0'; }
+    // the NUL sentinel marks the end of the buffer, which may just need refilling:
+    inline char peek_(){ return *current_ != '\0' ? *current_ : (refill_(), *current_); }
     inline char advance_(){ return *current_++; }
     inline bool isDigit_(char c){ return c >= '0' && c <= '9'; }
     inline bool isAlpha_(char c){ 
@@ -58,7 +75,7 @@ private:
                 c == '_';
     }
 
-    void incrementLine_();
+    bool refill_();
     void skipWhitespace_();
     bool matchNext_(char expected);
     
@@ -73,5 +90,14 @@ private:
 
     char const * start_;
     char const * current_;
-    uint16_t line_;
+    int line_;
+    char const * limit_;                // end of the data (in the active buffer, if streaming)
+    Simd::LexKernels kernels_;
+
+    // Streaming:
+    Source * source_;                   // null when scanning a string
+    std::vector<char> buffers_[2];      // scanned alternately, so the last token survives a refill
+    int activeBuffer_;
+    size_t bufferSize_;
+    bool switchedBuffers_;              // whether the token being scanned has switched buffers
 };
@@ -0,0 +1,227 @@
+#include "simd.hpp"
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Scalar: leave it all to the scanner
+ */
+static char const * scalarSkipWhitespace_(char const * p, char const * end, int & lines) {
+    (void)end; (void)lines;
+    return p;
+}
+
+static char const * scalarSkip_(char const * p, char const * end) {
+    (void)end;
+    return p;
+}
+
+static char const * scalarSkipString_(char const * p, char const * end, int & lines) {
+    (void)end; (void)lines;
+    return p;
+}
+
+static Simd::LexKernels const SCALAR_KERNELS_ = {
+    scalarSkipWhitespace_, scalarSkip_, scalarSkipString_, scalarSkip_
+};
+
+#ifdef SIMD_X86
+
+/**
+ * SSE2: 16 bytes at a time. Always there on x86-64, but not on 32-bit x86 (unless built
+ * with -msse2), so like AVX2 it's compiled for the target and only picked if the CPU has it
+ */
+#define SSE2_ __attribute__((target("sse2")))
+
+SSE2_ static inline uint32_t sse2Mask_(__m128i bytes, char c) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+}
+
+SSE2_ static char const * sse2SkipWhitespace_(char const * p, char const * end, int & lines) {
+    while( end - p >= 16 ){
+        __m128i bytes = _mm_loadu_si128((__m128i const *)p);
+        uint32_t newlines = sse2Mask_(bytes, '\n');
+        uint32_t space = newlines | sse2Mask_(bytes, ' ') | sse2Mask_(bytes, '\t') | sse2Mask_(bytes, '\r');
+        if( space != 0xFFFF ){
+            int run = __builtin_ctz(~space);
+            lines += __builtin_popcount(newlines & ((1u << run) - 1));
+            return p + run;
+        }
+        lines += __builtin_popcount(newlines);
+        p += 16;
+    }
+    return p;
+}
+
+SSE2_ static char const * sse2SkipComment_(char const * p, char const * end) {
+    while( end - p >= 16 ){
+        __m128i bytes = _mm_loadu_si128((__m128i const *)p);
+        uint32_t stop = sse2Mask_(bytes, '\n') | sse2Mask_(bytes, '\0');
+        if( stop != 0 ) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return p;
+}
+
+SSE2_ static char const * sse2SkipString_(char const * p, char const * end, int & lines) {
+    while( end - p >= 16 ){
+        __m128i bytes = _mm_loadu_si128((__m128i const *)p);
+        uint32_t newlines = sse2Mask_(bytes, '\n');
+        uint32_t stop = sse2Mask_(bytes, '"') | sse2Mask_(bytes, '\0');
+        if( stop != 0 ){
+            int run = __builtin_ctz(stop);
+            lines += __builtin_popcount(newlines & ((1u << run) - 1));
+            return p + run;
+        }
+        lines += __builtin_popcount(newlines);
+        p += 16;
+    }
+    return p;
+}
+
+SSE2_ static char const * sse2SkipDigits_(char const * p, char const * end) {
+    while( end - p >= 16 ){
+        __m128i bytes = _mm_loadu_si128((__m128i const *)p);
+        // signed compares: bytes >= 0x80 are negative, so count as below '0'
+        __m128i other = _mm_or_si128(_mm_cmplt_epi8(bytes, _mm_set1_epi8('0')),
+                                     _mm_cmpgt_epi8(bytes, _mm_set1_epi8('9')));
+        uint32_t stop = (uint32_t)_mm_movemask_epi8(other);
+        if( stop != 0 ) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return p;
+}
+
+static Simd::LexKernels const SSE2_KERNELS_ = {
+    sse2SkipWhitespace_, sse2SkipComment_, sse2SkipString_, sse2SkipDigits_
+};
+
+/**
+ * AVX2: 32 bytes at a time
+ */
+#define AVX2_ __attribute__((target("avx2")))
+
+AVX2_ static inline uint32_t avx2Mask_(__m256i bytes, char c) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)));
+}
+
+AVX2_ static char const * avx2SkipWhitespace_(char const * p, char const * end, int & lines) {
+    while( end - p >= 32 ){
+        __m256i bytes = _mm256_loadu_si256((__m256i const *)p);
+        uint32_t newlines = avx2Mask_(bytes, '\n');
+        uint32_t space = newlines | avx2Mask_(bytes, ' ') | avx2Mask_(bytes, '\t') | avx2Mask_(bytes, '\r');
+        if( space != 0xFFFFFFFF ){
+            int run = __builtin_ctz(~space);
+            lines += __builtin_popcount(newlines & ((1u << run) - 1));
+            return p + run;
+        }
+        lines += __builtin_popcount(newlines);
+        p += 32;
+    }
+    return sse2SkipWhitespace_(p, end, lines);
+}
+
+AVX2_ static char const * avx2SkipComment_(char const * p, char const * end) {
+    while( end - p >= 32 ){
+        __m256i bytes = _mm256_loadu_si256((__m256i const *)p);
+        uint32_t stop = avx2Mask_(bytes, '\n') | avx2Mask_(bytes, '\0');
+        if( stop != 0 ) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return sse2SkipComment_(p, end);
+}
+
+AVX2_ static char const * avx2SkipString_(char const * p, char const * end, int & lines) {
+    while( end - p >= 32 ){
+        __m256i bytes = _mm256_loadu_si256((__m256i const *)p);
+        uint32_t newlines = avx2Mask_(bytes, '\n');
+        uint32_t stop = avx2Mask_(bytes, '"') | avx2Mask_(bytes, '\0');
+        if( stop != 0 ){
+            int run = __builtin_ctz(stop);
+            lines += __builtin_popcount(newlines & ((1u << run) - 1));
+            return p + run;
+        }
+        lines += __builtin_popcount(newlines);
+        p += 32;
+    }
+    return sse2SkipString_(p, end, lines);
+}
+
+AVX2_ static char const * avx2SkipDigits_(char const * p, char const * end) {
+    while( end - p >= 32 ){
+        __m256i bytes = _mm256_loadu_si256((__m256i const *)p);
+        __m256i other = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('0'), bytes),
+                                        _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('9')));
+        uint32_t stop = (uint32_t)_mm256_movemask_epi8(other);
+        if( stop != 0 ) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return sse2SkipDigits_(p, end);
+}
+
+#undef AVX2_
+
+static Simd::LexKernels const AVX2_KERNELS_ = {
+    avx2SkipWhitespace_, avx2SkipComment_, avx2SkipString_, avx2SkipDigits_
+};
+
+#endif  // SIMD_X86
+
+static bool supported_(Simd::Level level) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+#endif
+    switch( level ){
+        case Simd::Level::SCALAR: return true;
+#ifdef SIMD_X86
+        case Simd::Level::SSE2: return __builtin_cpu_supports("sse2");
+        case Simd::Level::AVX2: return __builtin_cpu_supports("avx2");
+#endif
+        default: return false;
+    }
+}
+
+static Simd::LexKernels const & kernelsFor_(Simd::Level level) {
+    switch( level ){
+#ifdef SIMD_X86
+        case Simd::Level::SSE2: return SSE2_KERNELS_;
+        case Simd::Level::AVX2: return AVX2_KERNELS_;
+#endif
+        default: return SCALAR_KERNELS_;
+    }
+}
+
+static Simd::Level level_ = Simd::bestLevel();
+
+Simd::Level Simd::bestLevel() {
+    if( supported_(Level::AVX2) ) return Level::AVX2;
+    if( supported_(Level::SSE2) ) return Level::SSE2;
+    return Level::SCALAR;
+}
+
+bool Simd::setLevel(Level level) {
+    if( !supported_(level) ) return false;
+    level_ = level;
+    return true;
+}
+
+Simd::Level Simd::getLevel() {
+    return level_;
+}
+
+Simd::LexKernels const & Simd::lexKernels() {
+    return kernelsFor_(level_);
+}
+
+char const * Simd::levelName(Level level) {
+    switch( level ){
+        case Level::SCALAR: return "scalar";
+        case Level::SSE2:   return "SSE2";
+        case Level::AVX2:   return "AVX2";
+    }
+    return "?";
+}
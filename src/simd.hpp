@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+ * Vectorised scanning kernels for the Scanner
+ *
+ * Each kernel skips a run of one class of characters a block (16 or 32 bytes) at a
+ * time, and returns where the run ends. It only reads whole blocks before `end`, so it
+ * may stop short of the end of the run: the scanner's scalar loop carries on from
+ * there. The scalar "kernels" skip nothing.
+ *
+ * The best level the CPU supports is picked at startup (both SSE2 and AVX2 are checked
+ * with CPUID, SSE2 isn't a given on 32-bit x86); scanners pick up the current level when
+ * initialised.
+ */
+namespace Simd {
+
+enum class Level {
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+struct LexKernels {
+    // ' ', '\t', '\r' and '\n', adding the newlines skipped to `lines`
+    char const * (*skipWhitespace)(char const * p, char const * end, int & lines);
+    // anything up to a '\n' or NUL (the rest of a comment)
+    char const * (*skipComment)(char const * p, char const * end);
+    // anything up to a '"' or NUL (the rest of a string), adding the newlines skipped to `lines`
+    char const * (*skipString)(char const * p, char const * end, int & lines);
+    // '0' to '9'
+    char const * (*skipDigits)(char const * p, char const * end);
+};
+
+// Kernels for the current level
+LexKernels const & lexKernels();
+
+// Best level this CPU supports
+Level bestLevel();
+
+// Force a level (e.g. to compare against scalar): fails if the CPU doesn't support it
+bool setLevel(Level level);
+
+Level getLevel();
+
+char const * levelName(Level level);
+
+}
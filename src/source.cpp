@@ -0,0 +1,9 @@
+#include "source.hpp"
+
+
+FileSource::FileSource(FILE * file): file_(file) {
+}
+
+size_t FileSource::read(char * buffer, size_t size) {
+    return fread(buffer, 1, size, file_);
+}
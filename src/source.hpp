@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * A stream of source code, which the scanner pulls from a buffer at a time
+ * so that a whole file never has to be held in memory
+ */
+class Source {
+public:
+    virtual ~Source() {}
+
+    // Read up to `size` bytes into `buffer`, returning the number read (0 at the end)
+    virtual size_t read(char * buffer, size_t size) = 0;
+};
+
+/**
+ * Source read from an open file (which it doesn't own)
+ */
+class FileSource: public Source {
+public:
+    FileSource(FILE * file);
+
+    virtual ~FileSource() {}
+
+    virtual size_t read(char * buffer, size_t size) override;
+
+private:
+    FILE * file_;
+};
@@ -3,20 +3,7 @@
 #include "vm.hpp"
 #include <string.h>
 #include <stdarg.h>
-
-static uint32_t calcHash_(char const * str, int length);
-
-StringView::StringView(char const * c) {
-    chars_ = c;
-    length_ = (int)strlen(chars_);  // TODO does this include null terminator? Should it?
-    hash_ = calcHash_(chars_, length_);
-}
-
-StringView::StringView(char const * c, int len) {
-    chars_ = c;
-    length_ = len;
-    hash_ = calcHash_(chars_, length_);
-}
+#include <new>
 
 /**
  * ObjString
@@ -27,76 +14,152 @@ ObjString * ObjString::newString(Vm * vm, char const * str) {
 
 ObjString * ObjString::newString(Vm * vm, char const * str, int length) {
     // is string already interned?
-    ObjString * ostr = vm->getInternedStrings()->find(str, length);
+    StringKey key = StringKey::of(str, length);
+    ObjString * ostr = vm->getInternedStrings()->find(key);
     if( ostr != nullptr ) return ostr;  // already have that one!
 
-    // Allocate space for new string
-    char * chars = new char [length + 1];
-    memcpy(chars, str, length);
-    chars[length] = '\0';  // ensure null terminated
-
     // make a new string
-    return new ObjString(vm, chars, length);
+    return allocate_(vm, str, length, key.hash);
 }
 
 ObjString * ObjString::newStringFmt(Vm * vm, const char* fmt, ...) {
     va_list args;
 
-    // Work out buffer size by doing a dry run: 
-    va_start(args, fmt);
-    int len = vsnprintf(nullptr, 0, fmt, args);
-    va_end(args);
-
-    // Now do the real thing:
-    char * chars = new char[len+1];
+    // Try formatting into a small buffer, which is enough for most strings:
+    char small[64];
     va_start(args, fmt);
-    vsnprintf(chars, len+1, fmt, args);
+    int len = vsnprintf(small, sizeof(small), fmt, args);
     va_end(args);
 
-    // is string already interned?
-    ObjString * ostr = vm->getInternedStrings()->find(chars, len);
-    if( ostr != nullptr ) return ostr;  // already have that one!
+    char * chars = small;
+    if( len >= (int)sizeof(small) ){
+        // Too long: do the real thing in the Vm's scratch space
+        chars = vm->getScratchBuffer(len + 1);
+        va_start(args, fmt);
+        vsnprintf(chars, len+1, fmt, args);
+        va_end(args);
+    }
 
-    // make a new string
-    return new ObjString(vm, chars, len);
+    return newString(vm, chars, len);
 }
 
 ObjString * ObjString::concatenate(Vm * vm, ObjString * a, ObjString * b) {
-    // Make a new character array combining the strings
+    return concatenate(vm, a, b->get(), b->getLength());
+}
+
+ObjString * ObjString::concatenate(Vm * vm, ObjString * a, char const * b, int bLength) {
+    // Combine the strings in scratch space, so nothing is allocated if the result is already interned
     int aLen = a->getLength();
-    int bLen = b->getLength();
-    int len = aLen + bLen;
-    char * chars = new char[len+1];
+    int len = aLen + bLength;
+    char * chars = vm->getScratchBuffer(len + 1);  // never empty, so never a null buffer
     memcpy(chars, a->get(), aLen);
-    memcpy(&chars[aLen], b->get(), bLen);
-    chars[len] = '\0';
+    memcpy(&chars[aLen], b, bLength);
 
-    // is string already interned?
-    ObjString * ostr = vm->getInternedStrings()->find(chars, len);
-    if( ostr != nullptr ) return ostr;  // already have that one!
+    return newString(vm, chars, len);
+}
 
-    // make a new string
-    return new ObjString(vm, chars, len);
+ObjString * ObjString::allocate_(Vm * vm, char const * str, int length, uint32_t hash) {
+    // may collect garbage, so do it before the new object exists
+    void * mem = vm->allocateObj(allocationSize(length));
+    ObjString * ostr = new (mem) ObjString(length, hash);
+
+    char * chars = (char *)(ostr + 1);
+    memcpy(chars, str, length);
+    chars[length] = '\0';  // ensure null terminated
+
+    // Hand over to the Vm, and add to interned set
+    vm->registerObj(ostr);
+    vm->getInternedStrings()->add(ostr);
+    return ostr;
 }
 
-ObjString::ObjString(Vm * vm, char const * chars, int length): Obj(vm, Obj::Type::STRING)  {
-    chars_ = chars;
+ObjString::ObjString(int length, uint32_t hash): Obj(Obj::Type::STRING)  {
     length_ = length;
-    hash_ = calcHash_(chars_, length_);
+    hash_ = hash;
+}
 
-    // Add to interned set
-    vm->getInternedStrings()->add(this);
+/**
+ * String hash: wyhash (final version 4) reduced to 32 bits
+ *
+ * Reads 8 or 16 bytes at a time and mixes with 64x64->128 bit multiplies, so long
+ * strings hash several times faster than byte-at-a-time FNV-1a. Short strings (the
+ * common case: identifiers) take two overlapping reads, with no loop.
+ */
+static uint64_t const WY_SECRET_[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+// Multiply, returning the low and high halves of the 128 bit result
+static inline void wyMultiply_(uint64_t & a, uint64_t & b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    a = (uint64_t)r;
+    b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    a = lo;
+    b = hi;
+#endif
 }
 
-ObjString::~ObjString() {
-    delete[] chars_;
+static inline uint64_t wyMix_(uint64_t a, uint64_t b) {
+    wyMultiply_(a, b);
+    return a ^ b;
 }
 
-static uint32_t calcHash_(char const * str, int length) {
-    uint32_t hash = 2166136261u;
-    for (int i = 0; i < length; i++) {
-        hash ^= (uint8_t)str[i];
-        hash *= 16777619;
+static inline uint64_t wyRead8_(uint8_t const * p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t wyRead4_(uint8_t const * p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+uint32_t hashString(char const * str, int length) {
+    uint8_t const * p = (uint8_t const *)str;
+    size_t len = (size_t)length;
+    uint64_t seed = WY_SECRET_[0];
+    uint64_t a, b;
+
+    if( len <= 16 ){
+        if( len >= 4 ){
+            // two (possibly overlapping) pairs of 4 byte reads cover 4..16 bytes:
+            size_t mid = (len >> 3) << 2;
+            a = (wyRead4_(p) << 32) | wyRead4_(p + mid);
+            b = (wyRead4_(p + len - 4) << 32) | wyRead4_(p + len - 4 - mid);
+        }else if( len > 0 ){
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        }else{
+            a = b = 0;
+        }
+    }else{
+        size_t i = len;
+        if( i > 48 ){
+            // three independent lanes, so the multiplies overlap:
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = wyMix_(wyRead8_(p) ^ WY_SECRET_[1], wyRead8_(p + 8) ^ seed);
+                seed1 = wyMix_(wyRead8_(p + 16) ^ WY_SECRET_[2], wyRead8_(p + 24) ^ seed1);
+                seed2 = wyMix_(wyRead8_(p + 32) ^ WY_SECRET_[3], wyRead8_(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while( i > 48 );
+            seed ^= seed1 ^ seed2;
+        }
+        while( i > 16 ){
+            seed = wyMix_(wyRead8_(p) ^ WY_SECRET_[1], wyRead8_(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        // last 16 bytes (overlapping what was already mixed):
+        a = wyRead8_(p + i - 16);
+        b = wyRead8_(p + i - 8);
     }
-    return hash;
+
+    a ^= WY_SECRET_[1];
+    b ^= seed;
+    wyMultiply_(a, b);
+    return (uint32_t)wyMix_(a ^ WY_SECRET_[0] ^ len, b ^ WY_SECRET_[1]);
 }
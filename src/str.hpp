@@ -5,47 +5,35 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 
 // predeclare Vm
 class Vm;
 
 /**
- * Interface for strings
+ * Hash function used for all strings
  */
-class String {
-public:
-    virtual ~String() {}
-    virtual char const * get() const = 0;
-    virtual uint32_t getHash() const = 0;
-    virtual int getLength() const = 0;
-    virtual int type() const = 0;
-};
+uint32_t hashString(char const * str, int length);
 
 /**
- * A StringView class which doesn't own its string
+ * A string to look up by its contents: plain data, so table probes compare it
+ * directly without virtual calls or building a temporary string object
  */
-class StringView: public String {
-public:
-    StringView(char const * c);
-    StringView(char const * c, int len);
-
-    virtual ~StringView() {}
-
-    virtual char const * get() const override { return chars_; }
-    virtual uint32_t getHash() const override { return hash_; }
-    virtual int getLength() const override { return length_; }
-    virtual int type() const override { return 0; };
-
-private:
-    char const * chars_;
-    int length_;
-    uint32_t hash_;
+struct StringKey {
+    char const * chars;
+    int length;
+    uint32_t hash;
+
+    static StringKey of(char const * chars, int length) {
+        return StringKey{chars, length, hashString(chars, length)};
+    }
 };
 
 /**
  * Garbage-Collected String Object
+ * The characters are stored inline, directly after the object, in the same allocation
 */
-class ObjString : public Obj, public String {
+class ObjString : public Obj {
 public:
     /**
      * Constructor helpers - copies string memory into this class
@@ -62,24 +50,23 @@ public:
      * Constructor helper to make a string from two other strings
      */
     static ObjString * concatenate(Vm * vm, ObjString * a, ObjString * b);
+    static ObjString * concatenate(Vm * vm, ObjString * a, char const * b, int bLength);
 
-    virtual ~ObjString();
+    // Number of bytes used by a string of the given length
+    static size_t allocationSize(int length){ return sizeof(ObjString) + (size_t)length + 1; }
 
-    // implment Obj interface (trivial for strings)
-    virtual ObjString * toString() override { return this; }
-    virtual void print() override { printf("%s", chars_); }
-
-    // implement String interface:
-    virtual char const * get() const override { return chars_; }
-    virtual uint32_t getHash() const override { return hash_; }
-    virtual int getLength() const override { return length_; }
-    virtual int type() const override { return 1; };
+    char const * get() const { return (char const *)(this + 1); }
+    uint32_t getHash() const { return hash_; }
+    int getLength() const { return length_; }
+    StringKey key() const { return StringKey{get(), length_, hash_}; }
 private:
     // Private constructor: must construct with helper!
-    // Takes ownership of str
-    ObjString(Vm * vm, char const * str, int length);
+    ObjString(int length, uint32_t hash);
+
+    // Allocate space from the Vm and copy in the characters
+    static ObjString * allocate_(Vm * vm, char const * str, int length, uint32_t hash);
 
-    char const * chars_;  // null terminated sequence
     int length_;          // number of characters, NOT including null terminator
     uint32_t hash_;
+    // followed by the null terminated characters
 };
@@ -2,45 +2,109 @@
 #include "table.hpp"
 
 // ----------------------------------------------------------------------------
-// String Comparison Helpers
+// InternedStringSet
 // ----------------------------------------------------------------------------
-std::size_t StringHash::operator()(String const * key) const {
-    return key->getHash();
-}
+static int const INITIAL_CAPACITY_ = 64;
+static int const MAX_LOAD_PERCENT_ = 75;
 
-bool StringEqual::operator()(String const * lhs, String const * rhs) const {
-    return (lhs->getLength() == rhs->getLength()) && 
-            (memcmp(lhs->get(), rhs->get(), lhs->getLength()) == 0);
-}
+// marks an entry which has been removed, so probing continues past it
+static ObjString * const TOMBSTONE_ = (ObjString *) 1;
 
-// ----------------------------------------------------------------------------
-// InternedStringSet
-// ----------------------------------------------------------------------------
 StringSet::StringSet() {
+    entries_ = nullptr;
+    capacity_ = 0;
+    count_ = 0;
+    used_ = 0;
 }
 
 StringSet::~StringSet() {
+    delete[] entries_;
 }
 
-ObjString * StringSet::find(char const * chars, int len) {
-    // Search if string is already interned:
-    StringView lookup(chars, len);
-    auto key = set_.find(&lookup);
-    if( key == set_.end() )  return nullptr;  // not found
-    // Found it:
-    // Must be an ObjString because thats all we ever add to the set
-    return (ObjString*) *key;
+ObjString * StringSet::find(StringKey const & key) {
+    if( count_ == 0 ) return nullptr;
+
+    uint32_t mask = (uint32_t)capacity_ - 1;
+    for( uint32_t index = key.hash & mask; ; index = (index + 1) & mask ){
+        Entry & entry = entries_[index];
+        if( entry.str == nullptr ) return nullptr;  // end of the probe sequence: not found
+        if( entry.str != TOMBSTONE_ && entry.hash == key.hash &&
+            entry.str->getLength() == key.length && memcmp(entry.str->get(), key.chars, key.length) == 0 ){
+            return entry.str;
+        }
+    }
 }
 
 void StringSet::add(ObjString * ostr) {
-    set_.emplace(ostr);
+    if( (used_ + 1) * 100 > capacity_ * MAX_LOAD_PERCENT_ ){
+        grow_();
+    }
+
+    uint32_t mask = (uint32_t)capacity_ - 1;
+    uint32_t index = ostr->getHash() & mask;
+    // Can reuse the first empty or removed entry (strings are only added after a failed find)
+    while( entries_[index].str != nullptr && entries_[index].str != TOMBSTONE_ ){
+        index = (index + 1) & mask;
+    }
+    if( entries_[index].str == nullptr ) used_++;
+    entries_[index].str = ostr;
+    entries_[index].hash = ostr->getHash();
+    count_++;
+}
+
+bool StringSet::remove(ObjString * ostr) {
+    if( count_ == 0 ) return false;
+
+    Entry * entry = findEntry_(entries_, capacity_, ostr);
+    if( entry == nullptr ) return false;
+    // leave a tombstone so later entries in the probe sequence are still found
+    entry->str = TOMBSTONE_;
+    count_--;
+    return true;
+}
+
+StringSet::Entry * StringSet::findEntry_(Entry * entries, int capacity, ObjString * ostr) {
+    uint32_t mask = (uint32_t)capacity - 1;
+    for( uint32_t index = ostr->getHash() & mask; ; index = (index + 1) & mask ){
+        if( entries[index].str == ostr ) return &entries[index];
+        if( entries[index].str == nullptr ) return nullptr;
+    }
+}
+
+void StringSet::grow_() {
+    // only grow if the table is genuinely full, otherwise just clear out tombstones:
+    uint32_t capacity = (uint32_t)capacity_;
+    if( capacity == 0 ){
+        capacity = INITIAL_CAPACITY_;
+    }else if( (count_ + 1) * 100 > capacity_ * MAX_LOAD_PERCENT_ / 2 ){
+        capacity *= 2;
+    }
+
+    Entry * entries = new Entry[capacity]();
+    uint32_t mask = capacity - 1;
+    for( int i = 0; i < capacity_; ++i ){
+        Entry & entry = entries_[i];
+        if( entry.str == nullptr || entry.str == TOMBSTONE_ ) continue;
+
+        uint32_t index = entry.hash & mask;
+        while( entries[index].str != nullptr ){
+            index = (index + 1) & mask;
+        }
+        entries[index] = entry;
+    }
+
+    delete[] entries_;
+    entries_ = entries;
+    capacity_ = (int)capacity;
+    used_ = count_;
 }
 
 void StringSet::debug() {
     printf("Interned string set:\n");
-    for( auto & it : set_ ){
-        printf("  %p: 0x%8x %3i '%s'\n", 
-               (ObjString*) it, it->getHash(), it->getLength(), it->get());
+    for( int i = 0; i < capacity_; ++i ){
+        ObjString * it = entries_[i].str;
+        if( it == nullptr || it == TOMBSTONE_ ) continue;
+        printf("  %p: 0x%8x %3i '%s'\n", it, it->getHash(), it->getLength(), it->get());
     }
 }
 
@@ -50,31 +114,99 @@ void StringSet::debug() {
 
 
 HashMap::HashMap() {
+    entries_ = nullptr;
+    capacity_ = 0;
+    count_ = 0;
+    used_ = 0;
 }
 
 HashMap::~HashMap() {
+    delete[] entries_;
 }
 
 bool HashMap::set(ObjString * key, Value value) {
-    // returns pair of iterator and bool isNew:
-    return map_.insert_or_assign(key, value).second;
+    if( (used_ + 1) * 100 > capacity_ * MAX_LOAD_PERCENT_ ){
+        grow_();
+    }
+
+    Entry * entry = findEntry_(key);
+    bool isNew = entry->key != key;
+    if( isNew ){
+        if( entry->key == nullptr ) used_++;
+        entry->key = key;
+        count_++;
+    }
+    entry->value = value;
+    return isNew;
 }
 
 bool HashMap::get(ObjString * key, Value & value) {
-    auto search = map_.find(key);
-    if( search == map_.end() ) return false;
-    value = (*search).second;
+    if( count_ == 0 ) return false;
+
+    Entry * entry = findEntry_(key);
+    if( entry->key != key ) return false;
+    value = entry->value;
     return true;
 }
 
 bool HashMap::remove(ObjString * key) {
-    return map_.erase(key) == 1;
+    if( count_ == 0 ) return false;
+
+    Entry * entry = findEntry_(key);
+    if( entry->key != key ) return false;
+    // leave a tombstone so later entries in the probe sequence are still found
+    entry->key = TOMBSTONE_;
+    entry->value = Value::nil();
+    count_--;
+    return true;
+}
+
+HashMap::Entry * HashMap::findEntry_(ObjString * key) {
+    // The entry holding the key, or else where it should go: the first tombstone passed, or the empty end
+    uint32_t mask = (uint32_t)capacity_ - 1;
+    Entry * tombstone = nullptr;
+    for( uint32_t index = key->getHash() & mask; ; index = (index + 1) & mask ){
+        Entry & entry = entries_[index];
+        if( entry.key == key ) return &entry;
+        if( entry.key == nullptr ) return tombstone != nullptr ? tombstone : &entry;
+        if( entry.key == TOMBSTONE_ && tombstone == nullptr ) tombstone = &entry;
+    }
+}
+
+void HashMap::grow_() {
+    // only grow if the table is genuinely full, otherwise just clear out tombstones:
+    uint32_t capacity = (uint32_t)capacity_;
+    if( capacity == 0 ){
+        capacity = INITIAL_CAPACITY_;
+    }else if( (count_ + 1) * 100 > capacity_ * MAX_LOAD_PERCENT_ / 2 ){
+        capacity *= 2;
+    }
+
+    Entry * entries = new Entry[capacity]();
+    uint32_t mask = capacity - 1;
+    for( int i = 0; i < capacity_; ++i ){
+        Entry & entry = entries_[i];
+        if( entry.key == nullptr || entry.key == TOMBSTONE_ ) continue;
+
+        uint32_t index = entry.key->getHash() & mask;
+        while( entries[index].key != nullptr ){
+            index = (index + 1) & mask;
+        }
+        entries[index] = entry;
+    }
+
+    delete[] entries_;
+    entries_ = entries;
+    capacity_ = (int)capacity;
+    used_ = count_;
 }
 
 void HashMap::debug() {
-    for( const auto & [key, value] : map_ ){
-        printf("  '%s': ", key->get());
-        value.print();
+    for( int i = 0; i < capacity_; ++i ){
+        Entry & entry = entries_[i];
+        if( entry.key == nullptr || entry.key == TOMBSTONE_ ) continue;
+        printf("  '%s': ", entry.key->get());
+        entry.value.print();
         printf("\n");
     }
 }
@@ -4,43 +4,56 @@
 #include "value.hpp"
 
 #include "string.h"
-#include <unordered_set>
-#include <unordered_map>
 
 /**
- * Hash value of a String (for HashSet/HashMap impl)
- */
-struct StringHash {
-    std::size_t operator()(String const * key) const;
-};
-
-/**
- * Compare two Strings (for HashSet/HashMap impl)
- */
-struct StringEqual {
-    bool operator()(String const * lhs, String const * rhs) const;
-};
-
-/**
- * Set of strings. All elements must be ObjStrings
- * Key interface is used so we can do cheap lookups
+ * Set of interned strings. All elements must be ObjStrings
+ * Flat open-addressing table (linear probing) which stores each hash next to its
+ * pointer, so probes only touch the string itself on a likely match.
+ * The set holds weak references: the owner must remove strings before freeing them.
  */
 class StringSet {
 public:
     StringSet();
     ~StringSet();
 
-    ObjString * find(char const * chars, int len);
+    /**
+     * Look up a string by its contents
+     * @return the interned string, or nullptr if not found
+     */
+    ObjString * find(StringKey const & key);
+
     void add(ObjString * ostr);
 
+    /**
+     * Remove a string (e.g. before it is freed)
+     * @return true if the string was in the set
+     */
+    bool remove(ObjString * ostr);
+
+    int count() const { return count_; }
+
     void debug();
 
 private:
-    std::unordered_set<String*, StringHash, StringEqual> set_;
+    struct Entry {
+        ObjString * str;  // nullptr if empty, or TOMBSTONE_ if removed
+        uint32_t hash;
+    };
+
+    void grow_();
+    Entry * findEntry_(Entry * entries, int capacity, ObjString * ostr);
+
+    Entry * entries_;
+    int capacity_;  // always a power of two (or 0)
+    int count_;     // number of strings in the set
+    int used_;      // number of non-empty entries (strings and tombstones)
 };
 
 /**
  * HashMap of <ObjString*> keys, and <Value> values
+ * Keys are interned, so equal strings are the same object: probes compare pointers
+ * and the cached hash, never the characters. Flat open-addressing table (linear probing).
+ * The map holds weak references to its keys: the owner must keep them alive.
  */
 class HashMap {
 public:
@@ -68,5 +81,16 @@ public:
     void debug();
 
 private:
-    std::unordered_map<String*, Value, StringHash, StringEqual> map_;
+    struct Entry {
+        ObjString * key;  // nullptr if empty, or TOMBSTONE_ if removed
+        Value value;
+    };
+
+    void grow_();
+    Entry * findEntry_(ObjString * key);
+
+    Entry * entries_;
+    int capacity_;  // always a power of two (or 0)
+    int count_;     // number of keys in the map
+    int used_;      // number of non-empty entries (keys and tombstones)
 };
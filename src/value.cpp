@@ -1,42 +1,93 @@
 
 #include "value.hpp"
+#include "number.hpp"
 
 #include <stdio.h>
 
+Value promoteInteger(double result) {
+    return Value::number(result);
+}
+
+Value boxInteger(Vm * vm, int64_t integer) {
+    return Value::object(ObjInteger::newInteger(vm, integer));
+}
+
+// Compare exactly: converting the integer to a double could round it to the one it's compared to
+static bool integerEqualsDouble_(int64_t integer, double number) {
+    if( !(number >= -9223372036854775808.0 && number < 9223372036854775808.0) ) return false;  // or NaN
+    int64_t whole = (int64_t)number;
+    return (double)whole == number && whole == integer;
+}
+
 bool Value::equals(Value other) const {
-    if( type != other.type ) return false;
-
-    switch( type ){
-        case NIL:     return true;
-        case BOOL:    return as.boolean == other.as.boolean;
-        case NUMBER:  return as.number == as.number;
-        case OBJECT:{
-            if( as.obj->type == Obj::Type::STRING ){
-                // all strings are interned --> therefore can compare pointers
-                return asObjString() == other.asObjString();
-            }
-            return false; // TODO other object types
+    // an integer and a double are equal if they are the same number
+    if( isAnyInteger() ){
+        if( other.isAnyInteger() ) return toInteger() == other.toInteger();
+        return other.isNumber() && integerEqualsDouble_(toInteger(), other.asNumber());
+    }
+    if( isNumber() ){
+        // compare as doubles so that NaN != NaN and 0 == -0
+        if( other.isAnyInteger() ) return integerEqualsDouble_(other.toInteger(), asNumber());
+        return other.isNumber() && asNumber() == other.asNumber();
+    }
+    if( isNil() )     return other.isNil();
+    if( isBoolean() ) return other.isBoolean() && asBoolean() == other.asBoolean();
+    if( isObject() ){
+        if( !other.isObject() ) return false;
+        if( asObject()->type == Obj::Type::STRING ){
+            // all strings are interned --> therefore can compare pointers
+            return asObjString() == other.asObjString();
         }
-        default:      return false;   // Unreachable
+        return false; // TODO other object types
     }
+    return false;   // Unreachable
 }
 
 ObjString * Value::toString(Vm * vm) {
-    switch( type ){
-        case NIL:     return ObjString::newString(vm, "nil");
-        case BOOL:    return ObjString::newString(vm, as.boolean ? "true" : "false");
-        case NUMBER:  return ObjString::newStringFmt(vm, "%g", as.number);
-        case OBJECT:  return as.obj->toString();
-        default:      return ObjString::newString(vm, "???");
+    if( isNil() )     return ObjString::newString(vm, "nil");
+    if( isBoolean() ) return ObjString::newString(vm, asBoolean() ? "true" : "false");
+    if( isAnyInteger() ){
+        char buffer[NUMBER_BUFFER_SIZE];
+        return ObjString::newString(vm, buffer, formatInteger(toInteger(), buffer));
+    }
+    if( isNumber() ){
+        char buffer[NUMBER_BUFFER_SIZE];
+        return ObjString::newString(vm, buffer, formatNumber(asNumber(), buffer));
     }
+    if( isObject() )  return objectToString(vm, asObject());
+    return ObjString::newString(vm, "???");
 }
 
 void Value::print() const {
-    switch( type ){
-        case NIL:     printf("nil"); return;
-        case BOOL:    printf(as.boolean ? "true" : "false"); return;
-        case NUMBER:  printf("%g", as.number); return;
-        case OBJECT:  as.obj->print(); return;
-        default:      printf("???");
+    if( isNil() )          printf("nil");
+    else if( isBoolean() ) printf(asBoolean() ? "true" : "false");
+    else if( isAnyInteger() ){
+        char buffer[NUMBER_BUFFER_SIZE];
+        fwrite(buffer, 1, (size_t)formatInteger(toInteger(), buffer), stdout);
+    }
+    else if( isNumber() ){
+        char buffer[NUMBER_BUFFER_SIZE];
+        fwrite(buffer, 1, (size_t)formatNumber(asNumber(), buffer), stdout);
+    }
+    else if( isObject() )  printObject(asObject());
+    else                   printf("???");
+}
+
+void Value::write(Output & out) const {
+    if( isString() ){
+        out.write(asCString(), (size_t)asObjString()->getLength());
+    }else if( isAnyInteger() ){
+        char buffer[NUMBER_BUFFER_SIZE];
+        out.write(buffer, (size_t)formatInteger(toInteger(), buffer));
+    }else if( isNumber() ){
+        char buffer[NUMBER_BUFFER_SIZE];
+        out.write(buffer, (size_t)formatNumber(asNumber(), buffer));
+    }else if( isNil() ){
+        out.write("nil", 3);
+    }else if( isBoolean() ){
+        if( asBoolean() ) out.write("true", 4);
+        else              out.write("false", 5);
+    }else{
+        out.write("???", 3);
     }
 }
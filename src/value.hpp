@@ -2,43 +2,213 @@
 
 #include "object.hpp"
 #include "str.hpp"
+#include "integer.hpp"
+#include "output.hpp"
 #include <string>
 #include <string.h>
+#include <stdint.h>
 
+#ifdef NAN_BOXING
+
+/**
+ * NaN-boxed value: everything packed into a single 64-bit word
+ *
+ * Any double which isn't a quiet NaN is stored as-is. Otherwise the quiet NaN bits
+ * are set and the remaining bits hold a type tag (nil/false/true), or with INTEGER_TAG
+ * also set a 48-bit integer, or with the sign bit also set a 48-bit Obj pointer.
+ * Integers outside the 48-bit range are boxed in an ObjInteger.
+ */
+struct Value {
+    uint64_t bits;
+
+    static uint64_t const SIGN_BIT = 0x8000000000000000;
+    static uint64_t const QNAN     = 0x7ffc000000000000;
+
+    static uint64_t const TAG_NIL   = 1;
+    static uint64_t const TAG_FALSE = 2;
+    static uint64_t const TAG_TRUE  = 3;
+    static uint64_t const TAG_UNDEFINED = 4;
+
+    static uint64_t const NIL_VAL   = QNAN | TAG_NIL;
+    static uint64_t const FALSE_VAL = QNAN | TAG_FALSE;
+    static uint64_t const TRUE_VAL  = QNAN | TAG_TRUE;
+    static uint64_t const UNDEFINED_VAL = QNAN | TAG_UNDEFINED;
+
+    static uint64_t const INTEGER_TAG  = 0x0002000000000000;
+    static uint64_t const INTEGER_MASK = 0x0000ffffffffffff;  // two's complement payload
+
+    // Range of inline integer values (48 bits): others are boxed
+    static int64_t const INTEGER_MIN = -((int64_t)1 << 47);
+    static int64_t const INTEGER_MAX = ((int64_t)1 << 47) - 1;
+
+    // Constructor-likes:
+    static inline Value nil() { return Value{NIL_VAL}; }
+    static inline Value boolean(bool b) { return Value{b ? TRUE_VAL : FALSE_VAL}; }
+    static inline Value number(double n) { Value v; memcpy(&v.bits, &n, sizeof(n)); return v; }
+    static inline Value integer(int64_t i) { return Value{QNAN | INTEGER_TAG | ((uint64_t)i & INTEGER_MASK)}; }
+    static inline Value object(Obj * o) { return Value{SIGN_BIT | QNAN | (uint64_t)(uintptr_t)o}; }
+    static inline Value undefined() { return Value{UNDEFINED_VAL}; }
+
+    // Helpers for value types
+    inline bool isNil() const { return bits == NIL_VAL; }
+    inline bool isBoolean() const { return (bits | 1) == TRUE_VAL; }
+    inline bool isNumber() const { return (bits & QNAN) != QNAN; }
+    inline bool isInteger() const { return (bits & (SIGN_BIT | QNAN | INTEGER_TAG)) == (QNAN | INTEGER_TAG); }
+    inline bool isObject() const { return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT); }
+    inline bool isUndefined() const { return bits == UNDEFINED_VAL; }
+
+    // Unchecked accessors
+    inline bool asBoolean() const { return bits == TRUE_VAL; }
+    inline double asNumber() const { double n; memcpy(&n, &bits, sizeof(n)); return n; }
+    inline int64_t asInteger() const { return (int64_t)(bits << 16) >> 16; }  // sign extend the payload
+    inline Obj * asObject() const { return (Obj*)(uintptr_t)(bits & ~(SIGN_BIT | QNAN)); }
+
+    // Identity: the same bit pattern (unlike equals(), 0 and -0 differ and NaN is identical to itself)
+    inline bool identical(Value other) const { return bits == other.bits; }
+    inline uint64_t identityHash() const { return bits; }
+
+#else
+
+/**
+ * Tagged union value
+ */
 struct Value {
     enum Type {
         NIL,
         BOOL,
         NUMBER,
-        OBJECT
+        INTEGER,
+        OBJECT,
+        UNDEFINED
     } type;
 
     union {
         bool boolean;
         double number;
+        int64_t integer;
         Obj * obj;
     } as;
 
+    // Range of inline integer values: all of them, nothing is boxed
+    static int64_t const INTEGER_MIN = INT64_MIN;
+    static int64_t const INTEGER_MAX = INT64_MAX;
+
     // Constructor-likes:
     static inline Value nil() { return (Value){NIL, {.number = 0}}; }
     static inline Value boolean(bool b) { return (Value){BOOL, {.boolean = b}}; }
     static inline Value number(double n) { return (Value){NUMBER, {.number = n}}; }
+    static inline Value integer(int64_t i) { return (Value){INTEGER, {.integer = i}}; }
     static inline Value object(Obj * o) { return (Value){OBJECT, {.obj = o}}; }
+    static inline Value undefined() { return (Value){UNDEFINED, {.number = 0}}; }
 
     // Helpers for value types
     inline bool isNil() const { return type == NIL; }
     inline bool isBoolean() const { return type == BOOL; }
     inline bool isNumber() const { return type == NUMBER; }
+    inline bool isInteger() const { return type == INTEGER; }
     inline bool isObject() const { return type == OBJECT; }
+    inline bool isUndefined() const { return type == UNDEFINED; }
+
+    // Unchecked accessors
+    inline bool asBoolean() const { return as.boolean; }
+    inline double asNumber() const { return as.number; }
+    inline int64_t asInteger() const { return as.integer; }
+    inline Obj * asObject() const { return as.obj; }
+
+    // Identity: the same bit pattern (unlike equals(), 0 and -0 differ and NaN is identical to itself)
+    inline bool identical(Value other) const { return type == other.type && payloadBits_() == other.payloadBits_(); }
+    inline uint64_t identityHash() const { return payloadBits_() ^ ((uint64_t)type << 60); }
+
+private:
+    inline uint64_t payloadBits_() const {
+        switch( type ){
+            case BOOL:   return as.boolean;
+            case NUMBER: { uint64_t b; memcpy(&b, &as.number, sizeof(b)); return b; }
+            case INTEGER: return (uint64_t)as.integer;
+            case OBJECT: return (uint64_t)(uintptr_t)as.obj;
+            default:     return 0;
+        }
+    }
+public:
+
+#endif
+
+    // NOTE: isNumber() and asNumber() are for doubles only. Integers are a separate type,
+    // inline (isInteger(), the fast paths' check) or boxed, but all are numbers to scripts:
+    inline bool isBoxedInteger() const { return isObjType(Obj::Type::INTEGER); }
+    inline bool isAnyInteger() const { return isInteger() || isBoxedInteger(); }
+    inline int64_t toInteger() const { return isInteger() ? asInteger() : ((ObjInteger*)asObject())->get(); }
+    inline bool isNumeric() const { return isNumber() || isAnyInteger(); }
+    inline double toDouble() const { return isNumber() ? asNumber() : (double)toInteger(); }
+    static inline bool fitsInteger(int64_t i) { return i >= INTEGER_MIN && i <= INTEGER_MAX; }
+
+    // NOTE: undefined() is an internal sentinel (e.g. for global slots which haven't been defined),
+    // it is never visible to scripts
 
     // Helpers for object types
-    inline bool isObjType(Obj::Type t) const { return isObject() && as.obj->type == t; }
+    inline bool isObjType(Obj::Type t) const { return isObject() && asObject()->type == t; }
     inline bool isString() const { return isObjType(Obj::Type::STRING); }
-    inline ObjString * asObjString() const { return (ObjString*)as.obj; }
+    inline ObjString * asObjString() const { return (ObjString*)asObject(); }
     inline char const * asCString() const { return asObjString()->get(); }
 
+    // nil and false are falsey, everything else is truthy
+    inline bool isTruthy() const { return !isNil() && !(isBoolean() && !asBoolean()); }
+
     // value methods
     bool equals(Value other) const;
     ObjString * toString(Vm * vm);
-    void print() const;
+    void print() const;               // to stdout, for debugging
+    void write(Output & out) const;   // script output
+};
+
+/**
+ * The double result of integer arithmetic which overflowed 64 bits, and an integer which
+ * doesn't fit inline boxed in an ObjInteger (never collects, see ObjInteger::newInteger).
+ * Out of line so the integer fast paths below don't route every result through a floating
+ * point register or a call
+ */
+__attribute__((noinline, cold)) Value promoteInteger(double result);
+__attribute__((noinline, cold)) Value boxInteger(Vm * vm, int64_t integer);
+
+// An integer Value: inline if it fits, otherwise boxed
+inline Value integerValue(Vm * vm, int64_t integer) {
+    return Value::fitsInteger(integer) ? Value::integer(integer) : boxInteger(vm, integer);
+}
+
+/**
+ * Integer arithmetic: an integer result, unless it overflows 64 bits and is promoted to
+ * a double
+ */
+inline Value addIntegers(Vm * vm, int64_t a, int64_t b) {
+    int64_t r;
+    if( __builtin_add_overflow(a, b, &r) ) return promoteInteger((double)a + (double)b);
+    return integerValue(vm, r);
+}
+
+inline Value subtractIntegers(Vm * vm, int64_t a, int64_t b) {
+    int64_t r;
+    if( __builtin_sub_overflow(a, b, &r) ) return promoteInteger((double)a - (double)b);
+    return integerValue(vm, r);
+}
+
+inline Value multiplyIntegers(Vm * vm, int64_t a, int64_t b) {
+    int64_t r;
+    if( __builtin_mul_overflow(a, b, &r) ) return promoteInteger((double)a * (double)b);
+    return integerValue(vm, r);
+}
+
+inline Value negateInteger(Vm * vm, int64_t a) {
+    if( a == INT64_MIN ) return promoteInteger(-(double)a);
+    return integerValue(vm, -a);
+}
+
+/**
+ * Hash and compare Values by identity (for maps keyed on Value)
+ */
+struct ValueIdentityHash {
+    size_t operator()(Value v) const { return (size_t)(v.identityHash() * 0x9E3779B97F4A7C15ull >> 16); }
+};
+
+struct ValueIdentical {
+    bool operator()(Value a, Value b) const { return a.identical(b); }
 };
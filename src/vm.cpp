@@ -2,31 +2,133 @@
 #include "vm.hpp"
 #include "debug.hpp"
 #include "compiler.hpp"
+#include "optimizer.hpp"
+#include "number.hpp"
+#include "jit.hpp"
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <chrono>
 
+// Labels-as-values is a GCC/Clang extension: use the portable switch on other compilers
+#if defined(COMPUTED_GOTO) && !defined(__GNUC__)
+#undef COMPUTED_GOTO
+#endif
 
 Vm::Vm() {
+    chunk_ = nullptr;
+    optimize_ = false;
+    foldConstants_ = true;
+#ifdef DEBUG_TRACE_EXECUTION
+    jitMode_ = JitMode::NEVER;  // compiled code can't be traced
+#else
+    jitMode_ = JitMode::AUTO;
+#endif
     objects_ = nullptr;
+    nextGc_ = GC_INITIAL_THRESHOLD;
+    gcStats_ = GcStats{};
+    stack_.resize(1 + STACK_INITIAL, Value::nil());
     resetStack_();
 }
 
 Vm::~Vm() {
+    // chunks which outlive the Vm mustn't untrack themselves from it
+    for( Chunk * chunk : chunks_ ){
+        chunk->vm = nullptr;
+    }
     freeObjects_();
 }
 
+void Vm::trackChunk(Chunk * chunk) {
+    if( chunk->vm == this ) return;
+    assert(chunk->vm == nullptr);  // a chunk's constants belong to one Vm
+    chunk->vm = this;
+    chunks_.push_back(chunk);
+}
+
+void Vm::untrackChunk(Chunk * chunk) {
+    for( size_t i = 0; i < chunks_.size(); ++i ){
+        if( chunks_[i] == chunk ){
+            chunks_[i] = chunks_.back();
+            chunks_.pop_back();
+            break;
+        }
+    }
+    chunk->vm = nullptr;
+}
+
 InterpretResult Vm::interpret(char const * source) {
-    Compiler compiler(this);
     Chunk chunk;
-    if( !compiler.compile(source, chunk) ){
+    if( !compile(source, chunk) ){
         return InterpretResult::COMPILE_ERR;
     }
+    return run(chunk);
+}
+
+bool Vm::compile(char const * source, Chunk & chunk) {
+    Compiler compiler(this);
+    if( !compiler.compile(source, chunk) ){
+        return false;
+    }
+    runOptimizer_(chunk);
+    return true;
+}
+
+bool Vm::compile(Source * source, Chunk & chunk) {
+    Compiler compiler(this);
+    if( !compiler.compile(source, chunk) ){
+        return false;
+    }
+    runOptimizer_(chunk);
+    return true;
+}
+
+void Vm::runOptimizer_(Chunk & chunk) {
+    if( optimize_ ){
+        Optimizer optimizer;
+        int removed = optimizer.optimize(chunk);
+#ifdef DEBUG_TRACE_EXECUTION
+        printf("Optimizer removed %d instructions\n", removed);
+#endif
+    }
+}
+
+InterpretResult Vm::run(Chunk & chunk) {
+    trackChunk(&chunk);
     chunk_= &chunk;
     ip_ = chunk_->getCode();
-    return run_();
+    reserveStack_(chunk.getMaxStack());
+    InterpretResult result = useJit_(chunk) ? runJit_(chunk) : run_();
+    chunk_ = nullptr;
+    output_.flush();
+    return result;
+}
+
+void Vm::reserveStack_(int depth){
+    size_t used = (size_t)(stackTop_ - stackBase_());
+    if( 1 + used + (size_t)depth > stack_.size() ){
+        stack_.resize(1 + used + (size_t)depth);
+        stackTop_ = stackBase_() + used;
+    }
+}
+
+bool Vm::useJit_(Chunk & chunk){
+    if( jitMode_ == JitMode::NEVER ) return false;
+    if( chunk.getJitCode() != nullptr ) return true;
+
+    int runs = chunk.countRun();
+    if( jitMode_ == JitMode::AUTO && runs != JIT_HOT_RUNS ) return false;  // not hot (or already failed)
+    chunk.setJitCode(Jit::compile(chunk));
+    return chunk.getJitCode() != nullptr;
+}
+
+InterpretResult Vm::runJit_(Chunk & chunk){
+    Value * stackTop = chunk.getJitCode()->getEntry()(this, stackTop_, globalValues_.data());
+    if( stackTop == nullptr ) return InterpretResult::RUNTIME_ERR;  // already reported
+    stackTop_ = stackTop;
+    return InterpretResult::OK;
 }
 
 void Vm::registerObj(Obj * obj){
@@ -34,201 +136,597 @@ void Vm::registerObj(Obj * obj){
     objects_ = obj;        // new head
 }
 
-void Vm::deregisterObj(Obj * obj){
-    // TODO
+void * Vm::allocateObj(size_t bytes){
+    gcStats_.bytesAllocated += bytes;
+#ifdef DEBUG_STRESS_GC
+    collectGarbage();
+#else
+    if( gcStats_.bytesAllocated > nextGc_ ){
+        collectGarbage();
+    }
+#endif
+    return arena_.allocate(bytes);
 }
 
-void Vm::push(Value value) {
-    *stackTop_ = value;
-    stackTop_++;
+void * Vm::allocateObjNoCollect(size_t bytes){
+    gcStats_.bytesAllocated += bytes;
+    return arena_.allocate(bytes);
 }
 
-Value Vm::pop() {
-    stackTop_--;
-    if( stackTop_ == stack_-1 ){
-        printf("Fatal: pop empty stack\n");
-        exit(1);
+char * Vm::getScratchBuffer(int size){
+    if( (int)scratch_.size() < size ){
+        scratch_.resize((size_t)size);
     }
-    return *stackTop_;
+    return scratch_.data();
+}
+
+void Vm::collectGarbage(){
+    auto start = std::chrono::steady_clock::now();
+    size_t before = gcStats_.bytesAllocated;
+
+    markRoots_();
+    sweep_();
+
+    nextGc_ = gcStats_.bytesAllocated * GC_HEAP_GROW_FACTOR;
+    if( nextGc_ < GC_INITIAL_THRESHOLD ) nextGc_ = GC_INITIAL_THRESHOLD;
+
+    double pauseMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    gcStats_.collections++;
+    gcStats_.bytesFreed += before - gcStats_.bytesAllocated;
+    gcStats_.totalPauseMs += pauseMs;
+    if( pauseMs > gcStats_.maxPauseMs ) gcStats_.maxPauseMs = pauseMs;
 }
 
-Value Vm::peek(int index) {
-    return stackTop_[-1 - index];
+void Vm::markValue_(Value value){
+    if( value.isObject() ) markObj_(value.asObject());
 }
 
-bool Vm::binaryOp_(uint8_t op){
-    if( !peek(0).isNumber() || !peek(1).isNumber() ){
-        runtimeError_("Operands must be numbers.");
-        return false;
+void Vm::markObj_(Obj * obj){
+    // NOTE: strings don't reference other objects so there is nothing to trace through (yet)
+    obj->marked = true;
+}
+
+void Vm::markChunk_(Chunk * chunk){
+    for( int i = 0; i < chunk->numConstants(); ++i ){
+        markValue_(chunk->getConstant(i));
     }
+}
 
-    double b = pop().as.number;
-    double a = pop().as.number;
+void Vm::markRoots_(){
+    for( Value * slot = stackBase_(); slot < stackTop_; slot++ ){
+        markValue_(*slot);
+    }
+    for( ObjString * name : globalNames_ ){
+        markObj_(name);
+    }
+    for( Value value : globalValues_ ){
+        markValue_(value);
+    }
+    for( Chunk * chunk : chunks_ ){
+        markChunk_(chunk);
+    }
+    // NOTE: internedStrings_ is weak: unreachable strings are removed from it when swept
+}
+
+void Vm::sweep_(){
+    Obj ** link = &objects_;
+    while( *link != nullptr ){
+        Obj * obj = *link;
+        if( obj->marked ){
+            obj->marked = false;  // ready for the next collection
+            link = &obj->next;
+        }else{
+            *link = obj->next;  // unlink
+            freeObj_(obj);
+        }
+    }
+}
+
+void Vm::freeObj_(Obj * obj){
+    switch( obj->type ){
+        case Obj::Type::STRING:
+            internedStrings_.remove((ObjString *)obj);
+            break;
+        case Obj::Type::INTEGER:
+            break;
+    }
+    size_t size = objectSize(obj);
+    gcStats_.bytesAllocated -= size;
+    arena_.free(obj, size);
+}
+
+int Vm::getGlobalSlot(ObjString * name) {
+    Value slot;
+    if( globalSlots_.get(name, slot) ){
+        return (int)slot.asNumber();
+    }
+    if( (int)globalNames_.size() >= GLOBALS_MAX ) return -1;  // full!
+
+    int index = (int)globalNames_.size();
+    globalSlots_.set(name, Value::number(index));
+    globalNames_.push_back(name);
+    globalValues_.push_back(Value::undefined());
+    return index;
+}
+
+uint8_t Vm::quickenInteger_(uint8_t op){
     switch( op ){
-        case OpCode::GREATER:       push(Value::boolean( a > b )); break;
-        case OpCode::GREATER_EQUAL: push(Value::boolean( a >= b )); break;
-        case OpCode::LESS:          push(Value::boolean( a < b )); break;
-        case OpCode::LESS_EQUAL:    push(Value::boolean( a <= b )); break;
-        case OpCode::SUBTRACT:      push(Value::number( a - b )); break;
-        case OpCode::MULTIPLY:      push(Value::number( a * b )); break;
-        case OpCode::DIVIDE:        push(Value::number( a / b )); break;
+        case OpCode::SUBTRACT:      return OpCode::SUBTRACT_INT;
+        case OpCode::MULTIPLY:      return OpCode::MULTIPLY_INT;
+        case OpCode::DIVIDE:        return OpCode::DIVIDE_NUM;  // always a double
+        case OpCode::GREATER:       return OpCode::GREATER_INT;
+        case OpCode::GREATER_EQUAL: return OpCode::GREATER_EQUAL_INT;
+        case OpCode::LESS:          return OpCode::LESS_INT;
+        case OpCode::LESS_EQUAL:    return OpCode::LESS_EQUAL_INT;
+        default:                    return op;
     }
-    return true;
 }
 
-bool Vm::isTruthy_(Value value) {
-    switch( value.type ){
-        case Value::NIL:  return false;
-        case Value::BOOL: return value.as.boolean;
-        default:          return true;  // All other types are true!
+bool Vm::numericBinary(uint8_t op, Value a, Value b, Value & result){
+    if( a.isAnyInteger() && b.isAnyInteger() ){
+        int64_t x = a.toInteger();
+        int64_t y = b.toInteger();
+        switch( op ){
+            case OpCode::ADD:           result = addIntegers(this, x, y); return true;
+            case OpCode::SUBTRACT:      result = subtractIntegers(this, x, y); return true;
+            case OpCode::MULTIPLY:      result = multiplyIntegers(this, x, y); return true;
+            case OpCode::GREATER:       result = Value::boolean(x > y); return true;
+            case OpCode::GREATER_EQUAL: result = Value::boolean(x >= y); return true;
+            case OpCode::LESS:          result = Value::boolean(x < y); return true;
+            case OpCode::LESS_EQUAL:    result = Value::boolean(x <= y); return true;
+            default:                    break;  // division is always done in doubles
+        }
+    }
+    if( !a.isNumeric() || !b.isNumeric() ) return false;
+    double x = a.toDouble();
+    double y = b.toDouble();
+    switch( op ){
+        case OpCode::ADD:           result = Value::number(x + y); return true;
+        case OpCode::SUBTRACT:      result = Value::number(x - y); return true;
+        case OpCode::MULTIPLY:      result = Value::number(x * y); return true;
+        case OpCode::DIVIDE:        result = Value::number(x / y); return true;
+        case OpCode::GREATER:       result = Value::boolean(x > y); return true;
+        case OpCode::GREATER_EQUAL: result = Value::boolean(x >= y); return true;
+        case OpCode::LESS:          result = Value::boolean(x < y); return true;
+        case OpCode::LESS_EQUAL:    result = Value::boolean(x <= y); return true;
+        default:                    return false;
     }
 }
 
-void Vm::concatenate_() {
-    Value bValue = pop();
-    ObjString * b = bValue.toString(this);
-    ObjString * a = pop().asObjString();
-    push( Value::object(ObjString::concatenate(this, a, b)) );
+uint8_t Vm::quickenNumeric_(uint8_t op){
+    switch( op ){
+        case OpCode::SUBTRACT:      return OpCode::SUBTRACT_NUM;
+        case OpCode::MULTIPLY:      return OpCode::MULTIPLY_NUM;
+        case OpCode::DIVIDE:        return OpCode::DIVIDE_NUM;
+        case OpCode::GREATER:       return OpCode::GREATER_NUM;
+        case OpCode::GREATER_EQUAL: return OpCode::GREATER_EQUAL_NUM;
+        case OpCode::LESS:          return OpCode::LESS_NUM;
+        case OpCode::LESS_EQUAL:    return OpCode::LESS_EQUAL_NUM;
+        default:                    return op;
+    }
 }
 
-Value Vm::readConstant_() {
-    // look up constant from bytecode reference
-    return chunk_->getConstant(readByte_());
+void Vm::concatenate_() {
+    // keep both operands on the stack until the result exists, so they can't be collected:
+    ObjString * result;
+    if( peek(0).isNumeric() ){
+        // format straight into the result, without a string object for the number:
+        char buffer[NUMBER_BUFFER_SIZE];
+        int length = peek(0).isAnyInteger() ? formatInteger(peek(0).toInteger(), buffer) :
+                                              formatNumber(peek(0).asNumber(), buffer);
+        result = ObjString::concatenate(this, peek(1).asObjString(), buffer, length);
+    }else{
+        ObjString * b = peek(0).toString(this);
+        stackTop_[-1] = Value::object(b);
+        result = ObjString::concatenate(this, peek(1).asObjString(), b);
+    }
+    pop();
+    pop();
+    push( Value::object(result) );
 }
 
-ObjString * Vm::readString_() {
-    // look up constant from bytecode and cast to string:
-    Value constant = readConstant_();
-    assert(constant.isString());
-    return constant.asObjString();
+#ifdef DEBUG_TRACE_EXECUTION
+void Vm::traceInstruction_() {
+    output_.flush();  // keep script output in order with the trace
+    printf("          stack: ");
+    for( Value * slot = stackBase_(); slot < stackTop_; slot++ ){
+        printf("[ ");
+        slot->print();
+        printf(" ]");
+    }
+    printf("\n");
+
+    Dissassembler disasm(this);
+    disasm.disassembleInstruction(chunk_, (int)(ip_ - chunk_->getCode()));
 }
+#define TRACE_() do{ SYNC_(); traceInstruction_(); }while(0)
+#else
+#define TRACE_() do{}while(0)
+#endif
+
+/**
+ * Register caching: run_ keeps the instruction pointer, the stack top and the top value
+ * itself in locals (ip, sp, tos) rather than in the Vm, so an instruction whose result is
+ * used straight away by the next never goes through memory.
+ * The stack is [stackBase_(), sp) as usual, except that the top value is in tos and its
+ * slot at sp[-1] is stale. An empty stack's "top" is the spare slot below the base, so
+ * push and pop never need to check.
+ * SYNC_ writes the registers back before anything which can observe the Vm (allocation
+ * and collection, errors, tracing, returning), RELOAD_ picks up the stack again after.
+ */
+#define SYNC_()     do{ ip_ = ip; sp[-1] = tos; stackTop_ = sp; }while(0)
+#define RELOAD_()   do{ sp = stackTop_; tos = sp[-1]; }while(0)
+#define PUSH_(value) do{ Value pushed = (value); sp[-1] = tos; tos = pushed; sp++; }while(0)
+#define POP_()      do{ sp--; tos = sp[-1]; }while(0)
+#define READ_BYTE_()  (*ip++)
+#define READ_LONG_()  (ip += 3, readLongOperand(ip - 3))
+#define RUNTIME_ERROR_(...) \
+    do{ SYNC_(); runtimeError_(__VA_ARGS__); return InterpretResult::RUNTIME_ERR; }while(0)
+
+/**
+ * Dispatch macros:
+ * With COMPUTED_GOTO, each handler jumps straight to the next handler through the dispatch table
+ * (the switch is only used to decode the very first instruction). Otherwise every handler returns
+ * to the top of the loop and decodes via the portable switch.
+ * REDISPATCH_ runs `instr` again without reading another byte (after it was rewritten in place).
+ */
+#ifdef COMPUTED_GOTO
+#define OP_(name)   case OpCode::name: op_##name
+#define NEXT_()     do{ TRACE_(); instr = READ_BYTE_(); goto *dispatchTable[instr]; }while(0)
+#define REDISPATCH_()  goto *dispatchTable[instr]
+#else
+#define OP_(name)   case OpCode::name
+#define NEXT_()     continue
+#define REDISPATCH_()  goto dispatch
+#endif
+
+// Run `instr` (already read) again, after rewriting it back to its generic form
+#define DEOPTIMIZE_(generic) \
+    do{ instr = OpCode::generic; ip[-1] = instr; REDISPATCH_(); }while(0)
+
+// Quickened arithmetic or comparison on two doubles, replacing them with `result`.
+// Also takes a double and an integer (and, for division, two integers) as doubles.
+// (deoptimizing is rare, so it is kept off the fast path)
+#define NUMERIC_OP_(name, generic, result) \
+    OP_(name):{ \
+        double a, b; \
+        if( __builtin_expect(tos.isNumber() && sp[-2].isNumber(), 1) ){ \
+            b = tos.asNumber(); \
+            a = sp[-2].asNumber(); \
+        }else if( tos.isNumeric() && sp[-2].isNumeric() && \
+                  (OpCode::name == OpCode::DIVIDE_NUM || !(tos.isAnyInteger() && sp[-2].isAnyInteger())) ){ \
+            b = tos.toDouble(); \
+            a = sp[-2].toDouble(); \
+        }else{ \
+            DEOPTIMIZE_(generic); \
+        } \
+        sp--; \
+        tos = result; \
+        NEXT_(); \
+    }
+
+// Quickened arithmetic or comparison on two inline integers, replacing them with `result`
+// (which may be boxed, but boxing never collects so needs no sync)
+#define INTEGER_OP_(name, generic, result) \
+    OP_(name):{ \
+        if( __builtin_expect(!tos.isInteger() || !sp[-2].isInteger(), 0) ) DEOPTIMIZE_(generic); \
+        int64_t b = tos.asInteger(); \
+        int64_t a = sp[-2].asInteger(); \
+        sp--; \
+        tos = result; \
+        NEXT_(); \
+    }
+
+// Superinstruction: a global and a constant, both numbers, replaced by `intResult` (both
+// integers) or `numResult` (as doubles) pushed to the stack. Otherwise reports the error
+// the unfused instructions would have
+#define GLOBAL_CONST_OP_(name, intResult, numResult) \
+    OP_(name):{ \
+        slot = READ_BYTE_(); \
+        Value global = globalValues_[slot]; \
+        Value constant = chunk_->getConstant(READ_BYTE_()); \
+        if( global.isAnyInteger() && constant.isAnyInteger() ){ \
+            int64_t a = global.toInteger(); \
+            int64_t b = constant.toInteger(); \
+            PUSH_(intResult); \
+            NEXT_(); \
+        } \
+        if( __builtin_expect(!global.isNumeric() || !constant.isNumeric(), 0) ){ \
+            if( global.isUndefined() ) RUNTIME_ERROR_("Undefined variable '%s'.", globalNames_[slot]->get()); \
+            RUNTIME_ERROR_("Operands must be numbers."); \
+        } \
+        double a = global.toDouble(); \
+        double b = constant.toDouble(); \
+        PUSH_(numResult); \
+        NEXT_(); \
+    }
 
 InterpretResult Vm::run_() {
 #ifdef DEBUG_TRACE_EXECUTION
-    Dissassembler disasm;  
-
     internedStrings_.debug();
     debugObjectLinkedList(objects_);
 
     printf("Constants:\n");
-    for( uint8_t i =0; i < chunk_->numConstants(); ++i ){
+    for( int i =0; i < chunk_->numConstants(); ++i ){
         printf(" %i ", i);
         Value v = chunk_->getConstant(i);
-        if( v.isObject() ) printf("%p [", v.as.obj);
+        if( v.isObject() ) printf("%p [", v.asObject());
         v.print();
         printf("]\n");
     }
     printf("Globals:\n");
-    globals_.debug();
+    for( size_t i = 0; i < globalNames_.size(); ++i ){
+        printf(" %zu '%s': ", i, globalNames_[i]->get());
+        if( globalValues_[i].isUndefined() ){
+            printf("<undefined>");
+        }else{
+            globalValues_[i].print();
+        }
+        printf("\n");
+    }
     printf("====\n");
 
 #endif
 
-    for(;;) {
-
-#ifdef DEBUG_TRACE_EXECUTION
-        printf("          stack: ");
-        for( Value * slot = stack_; slot < stackTop_; slot++ ){
-            printf("[ ");
-            slot->print();
-            printf(" ]");
-        }
-        printf("\n");
-
-        disasm.disassembleInstruction(chunk_, (int)(ip_ - chunk_->getCode()));
+#ifdef COMPUTED_GOTO
+    // Indexed by opcode. No bounds check: the compiler only emits valid opcodes
+    static void * const dispatchTable[] = {
+        [OpCode::CONSTANT]      = &&op_CONSTANT,
+        [OpCode::NIL]           = &&op_NIL,
+        [OpCode::TRUE]          = &&op_TRUE,
+        [OpCode::FALSE]         = &&op_FALSE,
+        [OpCode::POP]           = &&op_POP,
+        [OpCode::DEFINE_GLOBAL] = &&op_DEFINE_GLOBAL,
+        [OpCode::GET_GLOBAL]    = &&op_GET_GLOBAL,
+        [OpCode::SET_GLOBAL]    = &&op_SET_GLOBAL,
+        [OpCode::EQUAL]         = &&op_EQUAL,
+        [OpCode::NOT_EQUAL]     = &&op_NOT_EQUAL,
+        [OpCode::GREATER]       = &&op_GREATER,
+        [OpCode::GREATER_EQUAL] = &&op_GREATER_EQUAL,
+        [OpCode::LESS]          = &&op_LESS,
+        [OpCode::LESS_EQUAL]    = &&op_LESS_EQUAL,
+        [OpCode::ADD]           = &&op_ADD,
+        [OpCode::SUBTRACT]      = &&op_SUBTRACT,
+        [OpCode::MULTIPLY]      = &&op_MULTIPLY,
+        [OpCode::DIVIDE]        = &&op_DIVIDE,
+        [OpCode::NEGATE]        = &&op_NEGATE,
+        [OpCode::NOT]           = &&op_NOT,
+        [OpCode::PRINT]         = &&op_PRINT,
+        [OpCode::RETURN]        = &&op_RETURN,
+        [OpCode::CONSTANT_LONG]      = &&op_CONSTANT_LONG,
+        [OpCode::DEFINE_GLOBAL_LONG] = &&op_DEFINE_GLOBAL_LONG,
+        [OpCode::GET_GLOBAL_LONG]    = &&op_GET_GLOBAL_LONG,
+        [OpCode::SET_GLOBAL_LONG]    = &&op_SET_GLOBAL_LONG,
+        [OpCode::ADD_NUM]           = &&op_ADD_NUM,
+        [OpCode::ADD_STR]           = &&op_ADD_STR,
+        [OpCode::SUBTRACT_NUM]      = &&op_SUBTRACT_NUM,
+        [OpCode::MULTIPLY_NUM]      = &&op_MULTIPLY_NUM,
+        [OpCode::DIVIDE_NUM]        = &&op_DIVIDE_NUM,
+        [OpCode::GREATER_NUM]       = &&op_GREATER_NUM,
+        [OpCode::GREATER_EQUAL_NUM] = &&op_GREATER_EQUAL_NUM,
+        [OpCode::LESS_NUM]          = &&op_LESS_NUM,
+        [OpCode::LESS_EQUAL_NUM]    = &&op_LESS_EQUAL_NUM,
+        [OpCode::ADD_INT]           = &&op_ADD_INT,
+        [OpCode::SUBTRACT_INT]      = &&op_SUBTRACT_INT,
+        [OpCode::MULTIPLY_INT]      = &&op_MULTIPLY_INT,
+        [OpCode::GREATER_INT]       = &&op_GREATER_INT,
+        [OpCode::GREATER_EQUAL_INT] = &&op_GREATER_EQUAL_INT,
+        [OpCode::LESS_INT]          = &&op_LESS_INT,
+        [OpCode::LESS_EQUAL_INT]    = &&op_LESS_EQUAL_INT,
+        [OpCode::ADD_GLOBAL_CONST]      = &&op_ADD_GLOBAL_CONST,
+        [OpCode::SUBTRACT_GLOBAL_CONST] = &&op_SUBTRACT_GLOBAL_CONST,
+        [OpCode::LESS_GLOBAL_CONST]     = &&op_LESS_GLOBAL_CONST,
+        [OpCode::DEFINE_GLOBAL_CONST]   = &&op_DEFINE_GLOBAL_CONST,
+        [OpCode::SET_GLOBAL_POP]        = &&op_SET_GLOBAL_POP,
+    };
 #endif
 
-        uint8_t instr = readByte_();
+    uint8_t * ip = ip_;
+    Value * sp = stackTop_;
+    Value tos = sp[-1];
+    uint8_t instr;
+    int slot;  // operand of the global instructions
+    for(;;) {
+        TRACE_();
+        instr = READ_BYTE_();
+#ifndef COMPUTED_GOTO
+    dispatch:
+#endif
         switch( instr ){
-            case OpCode::CONSTANT:{
-                push(readConstant_());
-                break;
+            OP_(CONSTANT):{
+                PUSH_(chunk_->getConstant(READ_BYTE_()));
+                NEXT_();
+            }
+            OP_(CONSTANT_LONG):{
+                PUSH_(chunk_->getConstant(READ_LONG_()));
+                NEXT_();
             }
-            case OpCode::NIL: push(Value::nil()); break;
-            case OpCode::TRUE: push(Value::boolean(true)); break;
-            case OpCode::FALSE: push(Value::boolean(false)); break;
-            case OpCode::POP: pop(); break;
-            case OpCode::DEFINE_GLOBAL: {
+            OP_(NIL): PUSH_(Value::nil()); NEXT_();
+            OP_(TRUE): PUSH_(Value::boolean(true)); NEXT_();
+            OP_(FALSE): PUSH_(Value::boolean(false)); NEXT_();
+            OP_(POP): POP_(); NEXT_();
+            OP_(DEFINE_GLOBAL_LONG):
+                slot = READ_LONG_();
+                goto defineGlobal;
+            OP_(DEFINE_GLOBAL):
+                slot = READ_BYTE_();
+            defineGlobal: {
                 // NOTE: re-defining globals is allowed!
-                ObjString * name = readString_();
-                globals_.set(name, peek(0));
-                pop(); // Note: lox has this late pop as `set` might trigger garbage collection
-                break;
+                globalValues_[slot] = tos;
+                POP_();
+                NEXT_();
             }
-            case OpCode::GET_GLOBAL: {
-                ObjString * name = readString_();
-                Value value;
-                if( !globals_.get(name, value) ){
-                    runtimeError_("Undefined variable '%s'.", name->get());
-                    return InterpretResult::RUNTIME_ERR;
+            OP_(GET_GLOBAL_LONG):
+                slot = READ_LONG_();
+                goto getGlobal;
+            OP_(GET_GLOBAL):
+                slot = READ_BYTE_();
+            getGlobal: {
+                Value value = globalValues_[slot];
+                if( value.isUndefined() ){
+                    RUNTIME_ERROR_("Undefined variable '%s'.", globalNames_[slot]->get());
                 }
-                push(value);
-                break;
+                PUSH_(value);
+                NEXT_();
             }
-            case OpCode::SET_GLOBAL: {
-                ObjString * name = readString_();
-                if( globals_.set(name, peek(0)) ){
-                    // Didn't expect this to be a new variable!
-                    globals_.remove(name); // undo the operation
-                    runtimeError_("Undefined variable '%s'.", name->get());
-                    return InterpretResult::RUNTIME_ERR;
+            OP_(SET_GLOBAL_LONG):
+                slot = READ_LONG_();
+                goto setGlobal;
+            OP_(SET_GLOBAL):
+                slot = READ_BYTE_();
+            setGlobal: {
+                if( globalValues_[slot].isUndefined() ){
+                    RUNTIME_ERROR_("Undefined variable '%s'.", globalNames_[slot]->get());
                 }
                 // don't pop: the assignment can be used in an expression
-                break;
+                globalValues_[slot] = tos;
+                NEXT_();
             }
-            case OpCode::EQUAL: {
-                push(Value::boolean( pop().equals(pop()) ));
-                break;
+            OP_(EQUAL): {
+                Value a = sp[-2];
+                sp--;
+                tos = Value::boolean( a.equals(tos) );
+                NEXT_();
             }
-            case OpCode::NOT_EQUAL: {
-                push(Value::boolean( !pop().equals(pop()) ));
-                break;
+            OP_(NOT_EQUAL): {
+                Value a = sp[-2];
+                sp--;
+                tos = Value::boolean( !a.equals(tos) );
+                NEXT_();
             }
-            case OpCode::GREATER:
-            case OpCode::GREATER_EQUAL:
-            case OpCode::LESS:
-            case OpCode::LESS_EQUAL:
-            case OpCode::SUBTRACT:
-            case OpCode::MULTIPLY:
-            case OpCode::DIVIDE:{
-                if( !binaryOp_(instr) ) return InterpretResult::RUNTIME_ERR;
-                break;
+            /**
+             * Generic arithmetic and comparison: check the operand types, then quicken the
+             * instruction (rewrite it in place) to the variant for those types and run that.
+             * Each quickened variant guards its operand types, and on a mismatch deoptimizes
+             * back to the generic instruction, which reports the error or quickens again.
+             */
+            OP_(GREATER):
+            OP_(GREATER_EQUAL):
+            OP_(LESS):
+            OP_(LESS_EQUAL):
+            OP_(SUBTRACT):
+            OP_(MULTIPLY):
+            OP_(DIVIDE):{
+                if( !tos.isNumeric() || !sp[-2].isNumeric() ){
+                    RUNTIME_ERROR_("Operands must be numbers.");
+                }
+                if( tos.isBoxedInteger() || sp[-2].isBoxedInteger() ) goto boxedInteger;
+                // two integers use the integer variant, doubles (or one of each) the double one
+                instr = tos.isInteger() && sp[-2].isInteger() ? quickenInteger_(instr) : quickenNumeric_(instr);
+                ip[-1] = instr;
+                REDISPATCH_();
             }
-            case OpCode::ADD:{
-                if( peek(1).isString() ){ 
-                    // implicitly convert second operand to string
-                    concatenate_();
-
-                }else if( peek(0).isNumber() && peek(1).isNumber() ){
-                    double b = pop().as.number;
-                    double a = pop().as.number;
-                    push(Value::number( a + b ));
+            OP_(ADD):{
+                if( sp[-2].isString() ){
+                    instr = OpCode::ADD_STR;
+                }else if( tos.isInteger() && sp[-2].isInteger() ){
+                    instr = OpCode::ADD_INT;
+                }else if( tos.isNumeric() && sp[-2].isNumeric() ){
+                    if( tos.isBoxedInteger() || sp[-2].isBoxedInteger() ) goto boxedInteger;
+                    instr = OpCode::ADD_NUM;
                 }else{
-                    runtimeError_("Invalid operands for +");
-                    return InterpretResult::RUNTIME_ERR;
+                    RUNTIME_ERROR_("Invalid operands for +");
                 }
-                break;
+                ip[-1] = instr;
+                REDISPATCH_();
             }
-            case OpCode::NEGATE:{
-                // ensure is numeric:
-                if( !peek(0).isNumber() ){
-                    runtimeError_("Operand must be a number");
-                    return InterpretResult::RUNTIME_ERR;
+            boxedInteger:{
+                // No quickened variant takes boxed integers (they're rare), so the generic
+                // instruction does the work itself. Boxing the result never collects: no sync
+                Value result;
+                numericBinary(instr, sp[-2], tos, result);
+                sp--;
+                tos = result;
+                NEXT_();
+            }
+            OP_(ADD_STR):{
+                if( !sp[-2].isString() ) DEOPTIMIZE_(ADD);
+                // implicitly convert second operand to string (allocates, so may collect)
+                SYNC_();
+                concatenate_();
+                RELOAD_();
+                NEXT_();
+            }
+            NUMERIC_OP_(ADD_NUM, ADD, Value::number( a + b ));
+            NUMERIC_OP_(SUBTRACT_NUM, SUBTRACT, Value::number( a - b ));
+            NUMERIC_OP_(MULTIPLY_NUM, MULTIPLY, Value::number( a * b ));
+            NUMERIC_OP_(DIVIDE_NUM, DIVIDE, Value::number( a / b ));
+            NUMERIC_OP_(GREATER_NUM, GREATER, Value::boolean( a > b ));
+            NUMERIC_OP_(GREATER_EQUAL_NUM, GREATER_EQUAL, Value::boolean( a >= b ));
+            NUMERIC_OP_(LESS_NUM, LESS, Value::boolean( a < b ));
+            NUMERIC_OP_(LESS_EQUAL_NUM, LESS_EQUAL, Value::boolean( a <= b ));
+            INTEGER_OP_(ADD_INT, ADD, addIntegers(this, a, b));
+            INTEGER_OP_(SUBTRACT_INT, SUBTRACT, subtractIntegers(this, a, b));
+            INTEGER_OP_(MULTIPLY_INT, MULTIPLY, multiplyIntegers(this, a, b));
+            INTEGER_OP_(GREATER_INT, GREATER, Value::boolean( a > b ));
+            INTEGER_OP_(GREATER_EQUAL_INT, GREATER_EQUAL, Value::boolean( a >= b ));
+            INTEGER_OP_(LESS_INT, LESS, Value::boolean( a < b ));
+            INTEGER_OP_(LESS_EQUAL_INT, LESS_EQUAL, Value::boolean( a <= b ));
+            OP_(ADD_GLOBAL_CONST):{
+                slot = READ_BYTE_();
+                Value global = globalValues_[slot];
+                Value constant = chunk_->getConstant(READ_BYTE_());
+                if( global.isAnyInteger() && constant.isAnyInteger() ){
+                    PUSH_(addIntegers( this, global.toInteger(), constant.toInteger() ));
+                    NEXT_();
                 }
-
-                push( Value::number(-pop().as.number) );
-                break;
+                if( global.isNumeric() && constant.isNumeric() ){
+                    PUSH_(Value::number( global.toDouble() + constant.toDouble() ));
+                    NEXT_();
+                }
+                if( global.isUndefined() ){
+                    RUNTIME_ERROR_("Undefined variable '%s'.", globalNames_[slot]->get());
+                }
+                if( !global.isString() ){
+                    RUNTIME_ERROR_("Invalid operands for +");
+                }
+                PUSH_(global);
+                PUSH_(constant);
+                SYNC_();
+                concatenate_();
+                RELOAD_();
+                NEXT_();
             }
-            case OpCode::NOT:{
-                push(Value::boolean(!isTruthy_(pop())));
-                break;
+            GLOBAL_CONST_OP_(SUBTRACT_GLOBAL_CONST, subtractIntegers(this, a, b), Value::number( a - b ));
+            GLOBAL_CONST_OP_(LESS_GLOBAL_CONST, Value::boolean( a < b ), Value::boolean( a < b ));
+            OP_(DEFINE_GLOBAL_CONST):{
+                slot = READ_BYTE_();
+                globalValues_[slot] = chunk_->getConstant(READ_BYTE_());
+                NEXT_();
             }
-            case OpCode::PRINT:{
-                pop().print();
-                printf("\n");
-                break;
+            OP_(SET_GLOBAL_POP):{
+                slot = READ_BYTE_();
+                if( globalValues_[slot].isUndefined() ){
+                    RUNTIME_ERROR_("Undefined variable '%s'.", globalNames_[slot]->get());
+                }
+                globalValues_[slot] = tos;
+                POP_();
+                NEXT_();
             }
-            case OpCode::RETURN:{
+            OP_(NEGATE):{
+                if( tos.isAnyInteger() ){
+                    tos = negateInteger(this, tos.toInteger());
+                }else if( tos.isNumber() ){
+                    tos = Value::number(-tos.asNumber());
+                }else{
+                    RUNTIME_ERROR_("Operand must be a number");
+                }
+                NEXT_();
+            }
+            OP_(NOT):{
+                tos = Value::boolean(!tos.isTruthy());
+                NEXT_();
+            }
+            OP_(PRINT):{
+                // NOTE: writing output doesn't allocate or look at the stack, so needs no sync
+                tos.write(output_);
+                output_.writeChar('\n');
+                POP_();
+                NEXT_();
+            }
+            OP_(RETURN):{
+                SYNC_();
                 return InterpretResult::OK;
             }
             default:{
@@ -239,7 +737,25 @@ InterpretResult Vm::run_() {
     }
 }
 
+#undef OP_
+#undef NEXT_
+#undef REDISPATCH_
+#undef DEOPTIMIZE_
+#undef NUMERIC_OP_
+#undef INTEGER_OP_
+#undef GLOBAL_CONST_OP_
+#undef TRACE_
+#undef SYNC_
+#undef RELOAD_
+#undef PUSH_
+#undef POP_
+#undef READ_BYTE_
+#undef READ_LONG_
+#undef RUNTIME_ERROR_
+
 void Vm::runtimeError_(const char* format, ...) {
+    output_.flush();  // everything printed before the error comes first
+
     va_list args;
     va_start(args, format);
     vfprintf(stderr, format, args);
@@ -257,7 +773,8 @@ void Vm::freeObjects_() {
     Obj * obj = objects_;
     while( obj != nullptr ){
         Obj * next  = obj->next;
-        delete obj;
+        freeObj_(obj);
         obj = next;
     }
+    objects_ = nullptr;
 }
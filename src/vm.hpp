@@ -4,8 +4,33 @@
 #include "value.hpp"
 #include "object.hpp"
 #include "table.hpp"
+#include "memory.hpp"
+#include "source.hpp"
+#include "output.hpp"
 
 #include <unordered_map>
+#include <vector>
+
+/**
+ * Garbage collector statistics
+ */
+struct GcStats {
+    size_t bytesAllocated;  // currently allocated to live (or not yet collected) objects
+    size_t bytesFreed;      // total freed by all collections
+    int collections;        // number of collections run
+    double totalPauseMs;    // total time spent collecting
+    double maxPauseMs;      // longest single collection
+};
+
+/**
+ * When chunks are compiled to native code (see Jit)
+ */
+enum class JitMode {
+    AUTO,    // once a chunk has been run JIT_HOT_RUNS times, if the JIT is supported. Only
+             // embedders re-run chunks: the command line runs each script or REPL line once
+    ALWAYS,  // on the first run, if the JIT is supported
+    NEVER    // always interpret
+};
 
 enum class InterpretResult {
     OK,
@@ -21,37 +46,153 @@ public:
 
     InterpretResult interpret(char const * source);
 
-    // stack operations:
-    void push(Value value);
-    Value pop();
-    Value peek(int index);  // index counts from top (end) of stack
+    // compile (and optimize, if enabled) without running
+    bool compile(char const * source, Chunk & chunk);
+    bool compile(Source * source, Chunk & chunk);
+
+    // run an already compiled chunk
+    InterpretResult run(Chunk & chunk);
+
+    // Whether interpret() runs the peephole optimizer over compiled chunks
+    void setOptimize(bool optimize){ optimize_ = optimize; }
+    bool getOptimize(){ return optimize_; }
+
+    // Whether the compiler evaluates constant expressions (off to check folding against the Vm)
+    void setFoldConstants(bool fold){ foldConstants_ = fold; }
+    bool getFoldConstants(){ return foldConstants_; }
 
-    // adding/removing objects, called from Obj(), ~Obj()
+    void setJitMode(JitMode mode){ jitMode_ = mode; }
+    JitMode getJitMode(){ return jitMode_; }
+
+    // Where print sends its output (buffered, flushed at the end of each run)
+    Output & getOutput(){ return output_; }
+
+    // Send script output to an embedder's sink instead of stdout (null for stdout)
+    void setOutputSink(OutputSink * sink){ output_.setSink(sink); }
+
+    /**
+     * Stack operations: unchecked, run() makes room for the deepest the chunk's stack
+     * gets (see Chunk::getMaxStack) before it starts
+     */
+    inline void push(Value value){ *stackTop_++ = value; }
+    inline Value pop(){ return *--stackTop_; }
+    inline Value peek(int index){ return stackTop_[-1 - index]; }  // index counts from top (end) of stack
+
+    /**
+     * Arithmetic or comparison `op` (a generic opcode) on two numbers, as scripts see it:
+     * integers stay integers (unless they overflow), anything involving a double or a
+     * division is a double. Shared by the Vm's slow paths and constant folding.
+     * May box the result (see ObjInteger::newInteger), but never collects.
+     * @return false if either operand isn't a number
+     */
+    bool numericBinary(uint8_t op, Value a, Value b, Value & result);
+
+    // Link a newly constructed object (from allocateObj) into the heap, for the collector to track
     void registerObj(Obj * obj);
-    void deregisterObj(Obj * obj);
+
+    /**
+     * Allocate memory for a new object, which must then be constructed in place.
+     * May run a collection, so anything the caller still needs must be reachable
+     * from the roots (stack, globals, tracked chunks).
+     */
+    void * allocateObj(size_t bytes);
+
+    /**
+     * Allocate memory for a new object without running a collection (the next allocateObj
+     * will, if it's due), for callers which can't make everything reachable first
+     */
+    void * allocateObjNoCollect(size_t bytes);
+
+    // Temporary buffer of at least `size` bytes, valid until the next call
+    char * getScratchBuffer(int size);
+
+    // Run a full mark and sweep collection
+    void collectGarbage();
+
+    // Collect once this many bytes are allocated (the threshold then grows with the heap)
+    void setGcThreshold(size_t bytes){ nextGc_ = bytes; }
+
+    GcStats const & getGcStats(){ return gcStats_; }
+
+    /**
+     * Keep a chunk's constants alive until the chunk is destroyed: from when it starts being
+     * compiled (or loaded), through however many runs, including between them. Done by the
+     * compiler, the cache and run(), and harmless to repeat
+     */
+    void trackChunk(Chunk * chunk);
+
+    // Stop keeping a chunk's constants alive (the chunk does this when it's destroyed)
+    void untrackChunk(Chunk * chunk);
 
     // intern string helper
     StringSet * getInternedStrings(){ return &internedStrings_; }
 
+    /**
+     * Look up the slot of a global variable, assigning a new (undefined) slot if
+     * the name hasn't been seen before. Called by the compiler.
+     */
+    int getGlobalSlot(ObjString * name);
+
+    // name of the global variable in a slot
+    ObjString * getGlobalName(int slot){ return globalNames_[slot]; }
+
+    // number of global slots assigned so far
+    int numGlobals(){ return (int)globalNames_.size(); }
+
+    static int const GLOBALS_MAX = 1 << 24;  // slot index must fit in a 24-bit operand
+
+    static int const JIT_HOT_RUNS = 8;
+
+    static int const STACK_MAX = 1 << 16;  // deepest operand stack a chunk may need
+
 private:
     InterpretResult run_();
-    inline uint8_t readByte_() { return *ip_++; }
-    inline void resetStack_() { stackTop_ = stack_; }
-    bool binaryOp_(uint8_t op);
-    bool isTruthy_(Value value);
+    InterpretResult runJit_(Chunk & chunk);
+    bool useJit_(Chunk & chunk);
+    void runOptimizer_(Chunk & chunk);
+#ifdef DEBUG_TRACE_EXECUTION
+    void traceInstruction_();
+#endif
+    inline Value * stackBase_() { return stack_.data() + 1; }
+    inline void resetStack_() { stackTop_ = stackBase_(); }
+    void reserveStack_(int depth);
+    static uint8_t quickenNumeric_(uint8_t op);
+    static uint8_t quickenInteger_(uint8_t op);
     void concatenate_();
     void runtimeError_(const char* format, ...);
-    Value readConstant_();
-    ObjString * readString_();
+    void markValue_(Value value);
+    void markObj_(Obj * obj);
+    void markChunk_(Chunk * chunk);
+    void markRoots_();
+    void sweep_();
+    void freeObj_(Obj * obj);
     void freeObjects_();
 
-    static int const STACK_MAX = 256;
+    static int const STACK_INITIAL = 256;
+    static size_t const GC_INITIAL_THRESHOLD = 1024 * 1024;
+    static int const GC_HEAP_GROW_FACTOR = 2;
 
     Chunk * chunk_;     // current chunk of bytecode
+    std::vector<Chunk*> chunks_;  // every chunk tracked: their constants are roots
     uint8_t * ip_;      // instruction pointer
-    Value stack_[STACK_MAX];
+    // Only ever grown between runs, so stack pointers stay valid. Slot 0 is a spare below
+    // the base, for run_'s cached top of an empty stack
+    std::vector<Value> stack_;
     Value * stackTop_;  // points past the last value in the stack
     Obj * objects_;     // linked list of objects
     StringSet internedStrings_;
-    HashMap globals_; 
+    HashMap globalSlots_;               // name -> slot index
+    std::vector<ObjString*> globalNames_;  // slot index -> name
+    std::vector<Value> globalValues_;      // slot index -> value (undefined until defined)
+    bool optimize_;
+    bool foldConstants_;
+    JitMode jitMode_;
+    Output output_;
+    Arena arena_;       // memory for objects
+    std::vector<char> scratch_;
+    size_t nextGc_;     // collect when bytes allocated exceeds this
+    GcStats gcStats_;
+
+    // Compiled code calls back into the Vm through the JIT's helper
+    friend class Jit;
 };
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Differential checks: runs every test/*.pond under two configurations of pond and
+# compares what comes out (stdout, stderr and the exit status)
+#
+#     sh test/check.sh bin/pond fold jit optimize
+#
+#   fold        constant folding (the default) against evaluating everything at runtime (-F)
+#   jit         compiling to native code (-J) against interpreting (-I)
+#   optimize    the peephole optimizer and superinstructions (-O) against plain bytecode
+#
+# pond must be built without execution tracing (make DEBUG_TRACE_EXECUTION=0), which
+# prints the bytecode it runs. The bytecode cache is never used (-C).
+
+POND="$1"
+shift
+if [ -z "$POND" ] || [ $# -eq 0 ]; then
+    echo "usage: sh test/check.sh <pond> fold|jit|optimize ..." >&2
+    exit 64
+fi
+
+TESTS=$(dirname "$0")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# run <flags> <script> <prefix>: save what a run produces as <prefix>.out/.err/.status
+run() {
+    "$POND" -C $1 "$2" >"$3.out" 2>"$3.err"
+    echo $? >"$3.status"
+}
+
+echo 'print 1;' >"$WORK/trace.pond"
+run "" "$WORK/trace.pond" "$WORK/trace"
+if [ "$(cat "$WORK/trace.out")" != "1" ]; then
+    echo "$POND traces execution: build it with DEBUG_TRACE_EXECUTION=0" >&2
+    exit 1
+fi
+
+failed=0
+checked=0
+for mode in "$@"; do
+    case "$mode" in
+        fold) reference="-I -F"; subject="-I" ;;
+        jit) reference="-I"; subject="-J" ;;
+        optimize) reference="-I"; subject="-I -O" ;;
+        *) echo "unknown check: $mode" >&2; exit 64 ;;
+    esac
+
+    # -J only warns and interprets without the JIT (only x86-64 Linux with NaN-boxed values)
+    if [ "$mode" = jit ]; then
+        run "-J" "$WORK/trace.pond" "$WORK/trace"
+        if [ -s "$WORK/trace.err" ]; then
+            echo "skipping jit: $(cat "$WORK/trace.err")"
+            continue
+        fi
+    fi
+
+    for script in "$TESTS"/*.pond; do
+        run "$reference" "$script" "$WORK/reference"
+        run "$subject" "$script" "$WORK/subject"
+        checked=$((checked + 1))
+        for part in status out err; do
+            if ! cmp -s "$WORK/reference.$part" "$WORK/subject.$part"; then
+                echo "FAIL $mode $script: $part differs ($reference vs $subject)"
+                diff "$WORK/reference.$part" "$WORK/subject.$part" | head -20
+                failed=$((failed + 1))
+                break
+            fi
+        done
+    done
+done
+
+echo "$checked checked, $failed failed"
+[ $failed -eq 0 ]